@@ -1,217 +1,299 @@
-﻿// FMOD headers
-#include "FMOD/fmod.hpp"
-#include "FMOD/fmod_errors.h"
-
-// FSBANK headers
-#include "FSBANK/fsbank.h"
-#include "FSBANK/fsbank_errors.h"
+﻿#include "libfsbtool/FsbTool.h"
 
 // Standard C++ headers
 #include <iostream>
-#include <fstream>
+#include <climits>
+#include <csignal>
+#include <cwctype>
 
 // Boost libraries
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/nowide/convert.hpp>
-#include <boost/locale.hpp>
 
-namespace fs = boost::filesystem;
+using namespace fsbtool;
 
-void ERRCHECK(FMOD_RESULT result) {
-#ifdef _DEBUG
-    if (result != FMOD_OK) {
-        wprintf(L"FMOD error! (%d) %s\n", result, FMOD_WErrorString(result));
-        exit(-1);
-    }
-#endif
+extern "C" void onInterrupt(int signal) {
+    requestCancel();
+    // A second Ctrl+C kills the process outright
+    std::signal(signal, SIG_DFL);
 }
 
-void ERRCHECK(FSBANK_RESULT result) {
-#ifdef _DEBUG
-    if (result != FSBANK_OK) {
-        wprintf(L"FSBANK error! (%d) %s\n", result, FSBank_WErrorString(result));
-        exit(-1);
+bool parseSize(const wchar_t* text, uint64_t& value) {
+    wchar_t* end = nullptr;
+    value = std::wcstoull(text, &end, 10);
+    if (end == text) {
+        return false;
     }
-#endif
-}
-
-void dumpFSB(const fs::path& filePath) {
-    FMOD::System* system = nullptr;
-    FMOD::Sound* sound = nullptr;
-    FMOD_RESULT result;
-    unsigned int version = 0;
-
-    result = FMOD::System_Create(&system);
-    ERRCHECK(result);
-
 
-    //only on fmodl.dll
-#ifdef _DEBUG
-    result = FMOD::Debug_Initialize(FMOD_DEBUG_LEVEL_LOG, FMOD_DEBUG_MODE_FILE, nullptr, "fmodlog.txt");
-    ERRCHECK(result);
-#endif
-
-    result = system->getVersion(&version);
-    ERRCHECK(result);
-
-    if (version < FMOD_VERSION) {
-        wprintf(L"Error!  You are using an old version of FMOD %08x.  This program requires %08x\n", version, FMOD_VERSION);
-        exit(-1);
+    switch (towupper(*end)) {
+    case L'G': value <<= 10; [[fallthrough]];
+    case L'M': value <<= 10; [[fallthrough]];
+    case L'K': value <<= 10; ++end; break;
     }
+    return *end == 0;
+}
 
-    result = system->init(32, FMOD_INIT_NORMAL, nullptr);
-    ERRCHECK(result);
-
-
-    std::string utf8FilePath = boost::locale::conv::utf_to_utf<char>(filePath.wstring());
-    result = system->createSound(utf8FilePath.c_str(), FMOD_DEFAULT, nullptr, &sound);
-    ERRCHECK(result);
-
-
-    int numSubSounds = 0;
-    result = sound->getNumSubSounds(&numSubSounds);
-    ERRCHECK(result);
-
-    std::vector<std::string> SoundNames;
-    for (int i = 0; i < numSubSounds; ++i) {
-        FMOD::Sound* subsound = nullptr;
-        result = sound->getSubSound(i, &subsound);
-        ERRCHECK(result);
-
-        std::vector<char> name(256);
-        result = subsound->getName(name.data(), static_cast<int>(name.size()));
-        ERRCHECK(result);
-        SoundNames.emplace_back(name.data());
-
-        result = subsound->release();
-        ERRCHECK(result);
+bool parseCount(const wchar_t* text, unsigned int& value) {
+    uint64_t parsed = 0;
+    if (!iswdigit(text[0]) || !parseSize(text, parsed) || parsed > UINT_MAX) {
+        return false;
     }
+    value = static_cast<unsigned int>(parsed);
+    return true;
+}
 
-    result = sound->release();
-    ERRCHECK(result);
-    result = system->release();
-    ERRCHECK(result);
-
-    // Export each sub sound as a WAV
-    for (int i = 0; i < numSubSounds; ++i) {
-        std::string filename = SoundNames[i] + ".wav";
-
-        FMOD::System* system;
-        FMOD::Sound* sound;
-        FMOD::Sound* subsound;
-        FMOD::Channel* channel;
-
-        result = FMOD::System_Create(&system);
-        ERRCHECK(result);
-
-        result = system->setOutput(FMOD_OUTPUTTYPE_WAVWRITER_NRT);
-        ERRCHECK(result);
-
-        result = system->init(32, FMOD_INIT_STREAM_FROM_UPDATE, (void*)filename.c_str());
-        ERRCHECK(result);
-
-        result = system->createSound(utf8FilePath.c_str(), FMOD_DEFAULT, nullptr, &sound);
-        ERRCHECK(result);
-
-        result = sound->getSubSound(i, &subsound);
-        ERRCHECK(result);
-
-        result = system->playSound(subsound, nullptr, false, &channel);
-        ERRCHECK(result);
+// A level below full scale in dBFS, optionally with a "dB" suffix
+bool parseDecibels(const wchar_t* text, double& decibels) {
+    wchar_t* end = nullptr;
+    double value = std::wcstod(text, &end);
+    if (end == text || !(value < 0.0) || value < -200.0) {
+        return false;
+    }
+    if (towlower(end[0]) == L'd' && towlower(end[1]) == L'b') {
+        end += 2;
+    }
+    decibels = value;
+    return *end == 0;
+}
 
-        bool playing = true;
-        while (playing) {
-            result = system->update();
-            ERRCHECK(result);
-            result = channel->isPlaying(&playing);
-            ERRCHECK(result);
-        }
+// Seconds, optionally with an "s" suffix, or frames with an "f" suffix
+bool parseTime(const wchar_t* text, ClipTime& time) {
+    wchar_t* end = nullptr;
+    double value = std::wcstod(text, &end);
+    if (end == text || value < 0.0) {
+        return false;
+    }
 
-        subsound->release();
-        sound->release();
-        system->release();
+    time.frames = towlower(*end) == L'f';
+    if (towlower(*end) == L's' || time.frames) {
+        ++end;
     }
+    time.value = value;
+    return *end == 0;
 }
 
-void createFSB(const boost::filesystem::path& filePath) {
-    FSBANK_RESULT result;
-    std::vector<std::wstring> fileNames;
-    std::string ext = boost::algorithm::to_lower_copy(filePath.extension().string());
+bool parseOptions(int argc, wchar_t** argv, int first, ToolOptions& options) {
+    unsigned int flacLevel = 0;
+    for (int i = first; i < argc; ++i) {
+        std::wstring arg = argv[i];
+        const wchar_t* value = i + 1 < argc ? argv[i + 1] : nullptr;
 
-    if (ext == ".txt") {
-        std::wifstream fileList(filePath.string());
-        if (!fileList) {
-            std::cerr << "Failed to open file list: " << filePath << "\n";
-            return;
+        if (arg == L"--output" && value) {
+            options.output = fs::absolute(value);
+            ++i;
         }
-
-        fileList.imbue(boost::locale::generator().generate("en_US.UTF-8"));
-
-        std::wstring line;
-        while (std::getline(fileList, line)) {
-            if (!line.empty()) {
-                fileNames.push_back(boost::filesystem::path(line).wstring());
-            }
+        else if (arg == L"--trace" && value) {
+            options.tracePath = fs::absolute(value);
+            ++i;
+        }
+        else if (arg == L"--cost-report" && value) {
+            options.costReportPath = fs::absolute(value);
+            ++i;
+        }
+        else if (arg == L"--cache" && value) {
+            options.cacheDirectory = fs::absolute(value);
+            ++i;
+        }
+        else if (arg == L"--timeout" && value && parseCount(value, options.timeout)) {
+            ++i;
+        }
+        else if (arg == L"--start" && value && parseTime(value, options.clipStart)) {
+            ++i;
+        }
+        else if (arg == L"--end" && value && parseTime(value, options.clipEnd)) {
+            ++i;
+        }
+        else if (arg == L"--preview" && value && parseTime(value, options.preview)) {
+            ++i;
+        }
+        else if (arg == L"--preview-wav" && value) {
+            options.previewReelPath = fs::absolute(value);
+            ++i;
+        }
+        else if (arg == L"--flac" && value && parseCount(value, flacLevel) && flacLevel <= 8) {
+            options.flacLevel = static_cast<int>(flacLevel);
+            ++i;
+        }
+        else if (arg == L"--dataset" && value) {
+            options.datasetPath = fs::absolute(value);
+            ++i;
+        }
+        else if (arg == L"--dataset-rate" && value && parseCount(value, options.datasetRate) && options.datasetRate < (1u << 20)) {
+            ++i;
+        }
+        else if (arg == L"--dataset-channels" && value && parseCount(value, options.datasetChannels) && options.datasetChannels <= 8) {
+            ++i;
+        }
+        else if (arg == L"--archive" && value) {
+            options.archivePath = fs::absolute(value);
+            ++i;
+        }
+        else if (arg == L"--subsound" && value) {
+            options.subsound = boost::nowide::narrow(value);
+            ++i;
+        }
+        else if (arg == L"--extract") {
+            options.extract = true;
+        }
+        else if (arg == L"--peaks") {
+            options.peaks = true;
+        }
+        else if (arg == L"--features" && value && (value == std::wstring(L"stft") || value == std::wstring(L"mel"))) {
+            options.features.kind = value == std::wstring(L"mel") ? FeatureKind::Mel : FeatureKind::Stft;
+            ++i;
+        }
+        else if (arg == L"--feature-window" && value && parseCount(value, options.features.window)) {
+            ++i;
+        }
+        else if (arg == L"--feature-hop" && value && parseCount(value, options.features.hop) && options.features.hop > 0) {
+            ++i;
+        }
+        else if (arg == L"--mels" && value && parseCount(value, options.features.mels) && options.features.mels > 0) {
+            ++i;
+        }
+        else if (arg == L"--trim" && value && parseDecibels(value, options.trimDb)) {
+            ++i;
+        }
+        else if (arg == L"--normalize" && value && parseDecibels(value, options.normalizeLufs)) {
+            ++i;
+        }
+        else if (arg == L"--trim-report" && value) {
+            options.trimReportPath = fs::absolute(value);
+            ++i;
+        }
+        else if (arg == L"--resume") {
+            options.resume = true;
+        }
+        else if (arg == L"--stdout") {
+            options.toStdout = true;
+        }
+        else if (arg == L"--raw") {
+            options.rawPcm = true;
+        }
+        else if (arg == L"--no-progress") {
+            options.progress = false;
+        }
+        else if (arg == L"--max-bank-size" && value && parseSize(value, options.maxBankSize)) {
+            ++i;
+        }
+        else if (arg == L"--max-entries" && value && parseCount(value, options.maxEntries)) {
+            ++i;
+        }
+        else if (arg == L"--jobs" && value && parseCount(value, options.jobs) && options.jobs > 0) {
+            ++i;
+        }
+        else if (arg == L"--pool-size" && value && parseSize(value, options.fmodPoolSize) && options.fmodPoolSize <= INT_MAX) {
+            ++i;
+        }
+        else if (arg == L"--read-block" && value && parseCount(value, options.readBlockSize)) {
+            ++i;
+        }
+        else if (arg == L"--dedup" && value && (value == std::wstring(L"alias") || value == std::wstring(L"skip"))) {
+            options.dedup = value == std::wstring(L"alias") ? DedupMode::Alias : DedupMode::Skip;
+            ++i;
+        }
+        else {
+            std::wcerr << L"Invalid option: " << arg << std::endl;
+            return false;
         }
     }
-    else {
-        fileNames.push_back(filePath.wstring());
-    }
-
-    //Init FSBank
-    result = FSBank_Init(FSBANK_FSBVERSION_FSB5, FSBANK_INIT_NORMAL, 1, nullptr);
-    ERRCHECK(result);
 
-    //vector array of soundbanks (for each file)
-    std::vector<FSBANK_SUBSOUND> subsounds(fileNames.size());
-    //converted strings
-    std::vector<std::string> utf8Strings;
-    //ptrs for them
-    std::vector<const char*> cfileNames;
+    // Archives and FLAC hold full exports only
+    bool clipping = options.clipStart.isSet() || options.clipEnd.isSet() || options.preview.isSet();
+    if (!options.archivePath.empty() && (clipping || options.peaks)) {
+        std::wcerr << L"--archive cannot be combined with --start, --end, --preview or --peaks" << std::endl;
+        return false;
+    }
+    if (options.flacLevel >= 0 && (clipping || options.peaks || options.toStdout)) {
+        std::wcerr << L"--flac cannot be combined with --start, --end, --preview, --peaks or --stdout" << std::endl;
+        return false;
+    }
 
-    for (size_t i = 0; i < fileNames.size(); ++i) {
+    // stdout carries the audio alone
+    if (options.toStdout && (options.peaks || !options.archivePath.empty() || !options.previewReelPath.empty())) {
+        std::wcerr << L"--stdout cannot be combined with --peaks, --archive or --preview-wav" << std::endl;
+        return false;
+    }
+    if (options.rawPcm && (!options.toStdout || options.subsound.empty())) {
+        std::wcerr << L"--raw needs --stdout and --subsound" << std::endl;
+        return false;
+    }
 
-        utf8Strings.push_back(boost::locale::conv::utf_to_utf<char>(fileNames[i]));
-        cfileNames.push_back(utf8Strings.back().c_str());
+    // A dataset replaces the per-subsound files, so only --start and --end carry over
+    if (options.datasetPath.empty() && (options.datasetRate || options.datasetChannels)) {
+        std::wcerr << L"--dataset-rate and --dataset-channels need --dataset" << std::endl;
+        return false;
+    }
+    if (!options.datasetPath.empty() && (options.preview.isSet() || options.peaks || !options.archivePath.empty() || options.flacLevel >= 0 || options.toStdout || !options.previewReelPath.empty())) {
+        std::wcerr << L"--dataset cannot be combined with --preview, --preview-wav, --peaks, --archive, --flac or --stdout" << std::endl;
+        return false;
+    }
 
-        subsounds[i] = {};
-        subsounds[i].fileNames = &cfileNames.back();
-        subsounds[i].numFiles = 1;
-        subsounds[i].overrideFlags = FSBANK_BUILD_DISABLESYNCPOINTS;
+    // Features are a sidecar to each WAV written on disk
+    const FeatureSettings& features = options.features;
+    if (features.isSet() && (!options.archivePath.empty() || options.flacLevel >= 0 || options.toStdout || !options.datasetPath.empty() || !options.previewReelPath.empty())) {
+        std::wcerr << L"--features cannot be combined with --archive, --flac, --stdout, --dataset or --preview-wav" << std::endl;
+        return false;
+    }
+    bool powerOfTwo = (features.window & (features.window - 1)) == 0;
+    if (!powerOfTwo || features.window < 64 || features.window > 65536 || features.hop > features.window || features.mels > features.window / 2) {
+        std::wcerr << L"--feature-window must be a power of two from 64 to 65536, with --feature-hop at most the window and --mels at most half of it" << std::endl;
+        return false;
     }
 
-    if (fileNames.size() == 1) {
-        auto outputPath = boost::nowide::narrow(filePath.filename().replace_extension(L".fsb").wstring());
-        result = FSBank_Build(subsounds.data(), static_cast<int>(subsounds.size()), FSBANK_FORMAT_VORBIS, FSBANK_BUILD_DEFAULT | FSBANK_BUILD_DONTLOOP, 100, nullptr, outputPath.c_str());
+    // Trailing silence is only known at the end, after the audio has gone into every other output
+    bool trimming = options.trimDb < 0.0;
+    if (!trimming && !options.trimReportPath.empty()) {
+        std::wcerr << L"--trim-report needs --trim" << std::endl;
+        return false;
     }
-    else {
-        result = FSBank_Build(subsounds.data(), static_cast<int>(subsounds.size()), FSBANK_FORMAT_VORBIS, FSBANK_BUILD_DEFAULT | FSBANK_BUILD_DONTLOOP, 100, nullptr, "Output.fsb");
+    if (trimming && (options.peaks || features.isSet() || !options.archivePath.empty() || options.flacLevel >= 0 || options.toStdout || !options.datasetPath.empty() || !options.previewReelPath.empty())) {
+        std::wcerr << L"--trim cannot be combined with --peaks, --features, --archive, --flac, --stdout, --dataset or --preview-wav" << std::endl;
+        return false;
     }
 
-    ERRCHECK(result);
+    // A reel without a length gets the default preview
+    if (!options.previewReelPath.empty() && !options.preview.isSet()) {
+        options.preview.value = 3.0;
+    }
 
-    result = FSBank_Release();
-    ERRCHECK(result);
+    return true;
 }
 
 
 int wmain(int argc, wchar_t** argv) {
     std::wstring mode;
     fs::path filePath;
+    ToolOptions options;
+    int firstOption = 3;
 
-    if (argc == 2) {
+    if (argc >= 2) {
         filePath = fs::absolute(argv[1]);
         std::wstring ext = filePath.extension().wstring();
         boost::algorithm::to_lower(ext);
         if (ext == L".fsb") {
             mode = L"dump";
+            firstOption = 2;
         }
     }
 
     if (mode != L"dump") {
         if (argc < 3) {
-            std::wcerr << L"Usage: " << argv[0] << L" <create|dump> <FSB/List>" << std::endl;
+            std::wcerr << L"Usage: " << argv[0] << L" <create|dump> <FSB/List> [options]" << std::endl;
+            std::wcerr << L"       " << argv[0] << L" <create-all|dump-all> <Directory> [options]" << std::endl;
+            std::wcerr << L"       " << argv[0] << L" scan <Any file> [--extract] [--peaks] [--jobs <n>]" << std::endl;
+            std::wcerr << L"       " << argv[0] << L" serve <Socket> [options]" << std::endl;
+            std::wcerr << L"  create: --output <fsb> --max-bank-size <bytes[K|M|G]> --max-entries <n> --dedup <alias|skip>" << std::endl;
+            std::wcerr << L"          --trace <json> --no-progress --cache <dir> --normalize <LUFS, e.g. -23>" << std::endl;
+            std::wcerr << L"  dump:   --pool-size <bytes[K|M|G]> --read-block <bytes[K|M], 0 = off> --resume --cost-report <csv>" << std::endl;
+            std::wcerr << L"          --subsound <name|index> --start <seconds|frames f> --end <seconds|frames f>" << std::endl;
+            std::wcerr << L"          --preview <seconds|frames f> --preview-wav <wav> --peaks --archive <tar|zip> --flac <0-8>" << std::endl;
+            std::wcerr << L"          --stdout [--raw] (one subsound as WAV or PCM, otherwise a multiplex)" << std::endl;
+            std::wcerr << L"          --dataset <blob> --dataset-rate <hz> --dataset-channels <n>" << std::endl;
+            std::wcerr << L"          --features <stft|mel> --feature-window <n> --feature-hop <n> --mels <n>" << std::endl;
+            std::wcerr << L"          --trim <dBFS, e.g. -60> --trim-report <csv>" << std::endl;
+            std::wcerr << L"  both:   --jobs <n> --timeout <seconds>" << std::endl;
             return -1;
         }
 
@@ -219,24 +301,49 @@ int wmain(int argc, wchar_t** argv) {
         filePath = fs::absolute(argv[2]);
     }
 
-    if (!fs::exists(filePath)) {
+    if (!parseOptions(argc, argv, firstOption, options)) {
+        return -1;
+    }
+
+    if (mode != L"serve" && !fs::exists(filePath)) {
         std::wcerr << L"File does not exist: " << filePath.wstring() << std::endl;
         return -1;
     }
 
+    std::signal(SIGINT, onInterrupt);
+    std::signal(SIGTERM, onInterrupt);
+    if (options.timeout) {
+        cancelDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(options.timeout);
+    }
+
     // Check modes
-    if (mode == L"dump") {
-        dumpFSB(filePath);
+    if (mode == L"dump" && options.toStdout) {
+        return streamFSB(filePath, options) ? 0 : 1;
+    }
+    else if (mode == L"dump") {
+        dumpFSB(filePath, options);
     }
     else if (mode == L"create") {
-        createFSB(filePath);
+        return createFSB(filePath, options) ? 0 : 1;
+    }
+    else if (mode == L"dump-all") {
+        dumpAll(filePath, options);
+    }
+    else if (mode == L"create-all") {
+        createAll(filePath, options);
+    }
+    else if (mode == L"scan") {
+        scanFile(filePath, options);
+    }
+    else if (mode == L"serve") {
+        serve(filePath, options);
     }
     else {
-        std::wcerr << L"Invalid mode. Use 'create' or 'dump'." << std::endl;
+        std::wcerr << L"Invalid mode. Use 'create', 'dump', 'create-all', 'dump-all', 'scan' or 'serve'." << std::endl;
         return -1;
     }
 
-    return 0;
+    return cancelRequested ? 1 : 0;
 }
 
 // Run program: Ctrl + F5 or Debug > Start Without Debugging menu
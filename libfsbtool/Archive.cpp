@@ -0,0 +1,319 @@
+﻿#include "Archive.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// Boost libraries
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/crc.hpp>
+
+namespace fsbtool {
+
+namespace {
+
+constexpr size_t kTarBlock = 512;
+constexpr uint64_t kZip32Max = 0xFFFFFFFF;
+
+void appendLE(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+// Octal and NUL terminated, or base-256 for values too large for the field
+void setTarNumber(char* field, size_t width, uint64_t value) {
+    if (value >> (3 * (width - 1))) {
+        memset(field, 0, width);
+        field[0] = static_cast<char>(0x80);
+        for (size_t i = width - 1; i > 0 && value; --i, value >>= 8) {
+            field[i] = static_cast<char>(value & 0xFF);
+        }
+        return;
+    }
+    snprintf(field, width, "%0*llo", static_cast<int>(width - 1), static_cast<unsigned long long>(value));
+}
+
+void makeTarHeader(char* header, const std::string& name, char type, uint64_t size, std::time_t mtime) {
+    memset(header, 0, kTarBlock);
+    memcpy(header, name.data(), std::min<size_t>(name.size(), 100));
+    setTarNumber(header + 100, 8, 0644);
+    setTarNumber(header + 108, 8, 0);
+    setTarNumber(header + 116, 8, 0);
+    setTarNumber(header + 124, 12, size);
+    setTarNumber(header + 136, 12, static_cast<uint64_t>(mtime));
+    header[156] = type;
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+
+    // The checksum is taken with its own field read as spaces
+    memset(header + 148, ' ', 8);
+    unsigned int checksum = 0;
+    for (size_t i = 0; i < kTarBlock; ++i) {
+        checksum += static_cast<unsigned char>(header[i]);
+    }
+    snprintf(header + 148, 8, "%06o", checksum);
+}
+
+void dosTime(std::time_t time, uint16_t& dosTime, uint16_t& dosDate) {
+    std::tm local = {};
+#ifdef _WIN32
+    localtime_s(&local, &time);
+#else
+    localtime_r(&time, &local);
+#endif
+    int year = std::max(local.tm_year + 1900, 1980);
+    dosTime = static_cast<uint16_t>((local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2));
+    dosDate = static_cast<uint16_t>(((year - 1980) << 9) | ((local.tm_mon + 1) << 5) | local.tm_mday);
+}
+
+} // namespace
+
+bool ArchiveWriter::open(const fs::path& archivePath) {
+    close();
+
+    path = archivePath;
+    partPath = archivePath.wstring() + L".part";
+    zip = boost::algorithm::to_lower_copy(archivePath.extension().wstring()) == L".zip";
+    failed = false;
+    created = std::time(nullptr);
+    offset = 0;
+    entries = 0;
+    records.clear();
+
+    out.open(partPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    // MSVC drops a buffer set before open, so it goes in after open and before the first write
+    buffer.resize(kBufferBytes);
+    out.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+    closing = false;
+    writer = std::thread(&ArchiveWriter::writeLoop, this);
+    return true;
+}
+
+void ArchiveWriter::add(std::string name, std::vector<char> data) {
+    if (!isOpen()) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(queueLock);
+    queueChanged.wait(guard, [&]() { return queue.empty() || queuedBytes < kMaxQueuedBytes; });
+    queuedBytes += data.size();
+    queue.push_back({ std::move(name), std::move(data) });
+    queueChanged.notify_all();
+}
+
+bool ArchiveWriter::close() {
+    if (!isOpen()) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        closing = true;
+    }
+    queueChanged.notify_all();
+    writer.join();
+
+    if (zip) {
+        finishZip();
+    }
+    else {
+        finishTar();
+    }
+    out.close();
+    failed = failed || out.fail();
+
+    if (failed) {
+        std::wcerr << L"Failed to write " << path.wstring() << std::endl;
+        fs::remove(partPath);
+        return false;
+    }
+    fs::rename(partPath, path);
+    return true;
+}
+
+void ArchiveWriter::writeLoop() {
+    while (true) {
+        Entry entry;
+        {
+            std::unique_lock<std::mutex> guard(queueLock);
+            queueChanged.wait(guard, [&]() { return closing || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            entry = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        if (!failed) {
+            if (zip) {
+                writeZip(entry);
+            }
+            else {
+                writeTar(entry);
+            }
+            failed = out.fail();
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            queuedBytes -= entry.data.size();
+        }
+        queueChanged.notify_all();
+    }
+}
+
+void ArchiveWriter::writeTar(const Entry& entry) {
+    char header[kTarBlock];
+    char padding[kTarBlock] = {};
+
+    // Names past the 100 byte field go in a GNU long name entry ahead of the header
+    if (entry.name.size() > 100) {
+        size_t nameSize = entry.name.size() + 1;
+        makeTarHeader(header, "././@LongLink", 'L', nameSize, 0);
+        out.write(header, kTarBlock);
+        out.write(entry.name.c_str(), nameSize);
+        out.write(padding, (kTarBlock - nameSize % kTarBlock) % kTarBlock);
+    }
+
+    makeTarHeader(header, entry.name, '0', entry.data.size(), created);
+    out.write(header, kTarBlock);
+    out.write(entry.data.data(), static_cast<std::streamsize>(entry.data.size()));
+    out.write(padding, (kTarBlock - entry.data.size() % kTarBlock) % kTarBlock);
+    ++entries;
+}
+
+void ArchiveWriter::finishTar() {
+    char end[kTarBlock * 2] = {};
+    out.write(end, sizeof(end));
+}
+
+void ArchiveWriter::writeZip(const Entry& entry) {
+    boost::crc_32_type crc;
+    crc.process_bytes(entry.data.data(), entry.data.size());
+
+    ZipRecord record;
+    record.name = entry.name;
+    record.crc = crc.checksum();
+    record.size = entry.data.size();
+    record.offset = offset;
+
+    uint16_t time = 0;
+    uint16_t date = 0;
+    dosTime(created, time, date);
+    bool zip64 = record.size >= kZip32Max;
+
+    std::string header;
+    appendLE(header, 0x04034b50, 4);
+    appendLE(header, zip64 ? 45 : 20, 2);
+    // Bit 11: the name is UTF-8
+    appendLE(header, 0x0800, 2);
+    appendLE(header, 0, 2);
+    appendLE(header, time, 2);
+    appendLE(header, date, 2);
+    appendLE(header, record.crc, 4);
+    appendLE(header, zip64 ? kZip32Max : record.size, 4);
+    appendLE(header, zip64 ? kZip32Max : record.size, 4);
+    appendLE(header, record.name.size(), 2);
+    appendLE(header, zip64 ? 20 : 0, 2);
+    header += record.name;
+    if (zip64) {
+        appendLE(header, 0x0001, 2);
+        appendLE(header, 16, 2);
+        appendLE(header, record.size, 8);
+        appendLE(header, record.size, 8);
+    }
+
+    out.write(header.data(), static_cast<std::streamsize>(header.size()));
+    out.write(entry.data.data(), static_cast<std::streamsize>(entry.data.size()));
+    offset += header.size() + entry.data.size();
+    records.push_back(std::move(record));
+    ++entries;
+}
+
+void ArchiveWriter::finishZip() {
+    uint16_t time = 0;
+    uint16_t date = 0;
+    dosTime(created, time, date);
+
+    std::string directory;
+    for (const ZipRecord& record : records) {
+        // Zip64 fields follow in this order, each only when its 32 bit field is saturated
+        std::string extra;
+        if (record.size >= kZip32Max) {
+            appendLE(extra, record.size, 8);
+            appendLE(extra, record.size, 8);
+        }
+        if (record.offset >= kZip32Max) {
+            appendLE(extra, record.offset, 8);
+        }
+        bool zip64 = !extra.empty();
+
+        appendLE(directory, 0x02014b50, 4);
+        appendLE(directory, 45, 2);
+        appendLE(directory, zip64 ? 45 : 20, 2);
+        appendLE(directory, 0x0800, 2);
+        appendLE(directory, 0, 2);
+        appendLE(directory, time, 2);
+        appendLE(directory, date, 2);
+        appendLE(directory, record.crc, 4);
+        appendLE(directory, std::min(record.size, kZip32Max), 4);
+        appendLE(directory, std::min(record.size, kZip32Max), 4);
+        appendLE(directory, record.name.size(), 2);
+        appendLE(directory, zip64 ? extra.size() + 4 : 0, 2);
+        appendLE(directory, 0, 2);
+        appendLE(directory, 0, 2);
+        appendLE(directory, 0, 2);
+        appendLE(directory, 0, 4);
+        appendLE(directory, std::min(record.offset, kZip32Max), 4);
+        directory += record.name;
+        if (zip64) {
+            appendLE(directory, 0x0001, 2);
+            appendLE(directory, extra.size(), 2);
+            directory += extra;
+        }
+    }
+
+    uint64_t directoryOffset = offset;
+    uint64_t directorySize = directory.size();
+    std::string end;
+    if (records.size() >= 0xFFFF || directoryOffset >= kZip32Max || directorySize >= kZip32Max) {
+        uint64_t zip64End = directoryOffset + directorySize;
+        appendLE(end, 0x06064b50, 4);
+        appendLE(end, 44, 8);
+        appendLE(end, 45, 2);
+        appendLE(end, 45, 2);
+        appendLE(end, 0, 4);
+        appendLE(end, 0, 4);
+        appendLE(end, records.size(), 8);
+        appendLE(end, records.size(), 8);
+        appendLE(end, directorySize, 8);
+        appendLE(end, directoryOffset, 8);
+
+        appendLE(end, 0x07064b50, 4);
+        appendLE(end, 0, 4);
+        appendLE(end, zip64End, 8);
+        appendLE(end, 1, 4);
+    }
+
+    appendLE(end, 0x06054b50, 4);
+    appendLE(end, 0, 2);
+    appendLE(end, 0, 2);
+    appendLE(end, std::min<uint64_t>(records.size(), 0xFFFF), 2);
+    appendLE(end, std::min<uint64_t>(records.size(), 0xFFFF), 2);
+    appendLE(end, std::min(directorySize, kZip32Max), 4);
+    appendLE(end, std::min(directoryOffset, kZip32Max), 4);
+    appendLE(end, 0, 2);
+
+    out.write(directory.data(), static_cast<std::streamsize>(directory.size()));
+    out.write(end.data(), static_cast<std::streamsize>(end.size()));
+}
+
+} // namespace fsbtool
@@ -0,0 +1,80 @@
+﻿#pragma once
+
+// Standard C++ headers
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+// Tar or stored (uncompressed) zip written by one thread. Workers hand over finished entries
+// whole, so every header is known before it is written, and the writer appends them in arrival
+// order through a large buffer. The archive is built under a temporary name and renamed on close.
+class ArchiveWriter {
+public:
+    static constexpr size_t kMaxQueuedBytes = 256 * 1024 * 1024;
+    static constexpr size_t kBufferBytes = 8 * 1024 * 1024;
+
+    ~ArchiveWriter() { close(); }
+
+    // A .zip extension selects zip, anything else tar
+    bool open(const fs::path& path);
+    // Blocks while kMaxQueuedBytes are already waiting, so decoding cannot run far ahead of the disk
+    void add(std::string name, std::vector<char> data);
+    // Writes the queued entries and the trailer. Also called for a cancelled run, which leaves a
+    // valid archive of the entries added so far.
+    bool close();
+
+    bool isOpen() const { return writer.joinable(); }
+    uint64_t getEntries() const { return entries; }
+
+private:
+    struct Entry {
+        std::string name;
+        std::vector<char> data;
+    };
+
+    struct ZipRecord {
+        std::string name;
+        uint32_t crc;
+        uint64_t size;
+        uint64_t offset;
+    };
+
+    void writeLoop();
+    void writeTar(const Entry& entry);
+    void writeZip(const Entry& entry);
+    void finishTar();
+    void finishZip();
+
+    fs::path path;
+    fs::path partPath;
+    fs::ofstream out;
+    std::vector<char> buffer;
+    bool zip = false;
+    bool failed = false;
+    std::time_t created = 0;
+    uint64_t offset = 0;
+    uint64_t entries = 0;
+    std::vector<ZipRecord> records;
+
+    std::mutex queueLock;
+    std::condition_variable queueChanged;
+    std::deque<Entry> queue;
+    size_t queuedBytes = 0;
+    bool closing = false;
+    std::thread writer;
+};
+
+} // namespace fsbtool
@@ -0,0 +1,290 @@
+﻿#include "BankBuilder.h"
+#include "BankHeader.h"
+#include "Common.h"
+#include "PoolAllocator.h"
+
+// Standard C++ headers
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <thread>
+
+// Boost libraries
+#include <boost/filesystem/fstream.hpp>
+#include <boost/nowide/convert.hpp>
+
+namespace fsbtool {
+
+namespace {
+
+// Drains FSBank progress items on a background thread while FSBank_Build runs, keeping one
+// timed span per subsound stage for the live status line, the summary and the Chrome trace.
+class BuildProgress {
+public:
+    BuildProgress(const std::vector<std::string>& names, bool live, bool namesRestored) : names(names), live(live), namesRestored(namesRestored) {}
+
+    void start() {
+        begin = std::chrono::steady_clock::now();
+        running = true;
+        poller = std::thread([this]() {
+            bool cancelSent = false;
+            while (running) {
+                if (!cancelSent && shouldCancel()) {
+                    FSBank_BuildCancel();
+                    cancelSent = true;
+                }
+                drain();
+                if (live) {
+                    printStatus();
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            drain();
+        });
+    }
+
+    void stop() {
+        running = false;
+        poller.join();
+        if (live) {
+            printStatus();
+            std::wcout << std::endl;
+        }
+        printWarnings();
+    }
+
+    void printSummary() const {
+        double wall = elapsed();
+        double stageTime[FSBANK_STATE_FINISHED] = {};
+        std::map<int, double> threadTime;
+        for (const auto& span : spans) {
+            stageTime[span.state] += span.end - span.start;
+            threadTime[span.thread] += span.end - span.start;
+        }
+
+        std::wcout << L"Build took " << wall << L"s" << std::endl;
+        for (int state = 0; state < FSBANK_STATE_FINISHED; ++state) {
+            std::wcout << L"  " << stateName(state) << L": " << stageTime[state] << L"s" << std::endl;
+        }
+        for (const auto& thread : threadTime) {
+            std::wcout << L"  thread " << thread.first << L": " << static_cast<int>(100.0 * thread.second / wall) << L"% busy" << std::endl;
+        }
+    }
+
+    void writeTrace(const fs::path& tracePath) const {
+        fs::ofstream trace(tracePath);
+        trace << "{\"traceEvents\":[";
+        for (size_t i = 0; i < spans.size(); ++i) {
+            const Span& span = spans[i];
+            trace << (i ? ",\n" : "\n") << "{\"name\":\"" << jsonEscape(subsoundName(span.subsound)) << "\",\"cat\":\""
+                << boost::nowide::narrow(stateName(span.state)) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.thread
+                << ",\"ts\":" << static_cast<int64_t>(span.start * 1e6) << ",\"dur\":" << static_cast<int64_t>((span.end - span.start) * 1e6) << "}";
+        }
+        trace << "\n]}\n";
+    }
+
+private:
+    struct Span {
+        int subsound;
+        int thread;
+        int state;
+        double start;
+        double end;
+    };
+
+    static const wchar_t* stateName(int state) {
+        static const wchar_t* stateNames[] = { L"DECODING", L"ANALYSING", L"PREPROCESSING", L"ENCODING", L"WRITING" };
+        return state >= 0 && state < FSBANK_STATE_FINISHED ? stateNames[state] : L"?";
+    }
+
+    static std::string jsonEscape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            if (static_cast<unsigned char>(c) >= 0x20) {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    std::string subsoundName(int subsound) const {
+        return subsound >= 0 && subsound < static_cast<int>(names.size()) ? names[subsound] : "bank";
+    }
+
+    double elapsed() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    void drain() {
+        const FSBANK_PROGRESSITEM* item = nullptr;
+        while (FSBank_FetchNextProgressItem(&item) == FSBANK_OK && item) {
+            handle(*item);
+            FSBank_ReleaseProgressItem(item);
+        }
+    }
+
+    void handle(const FSBANK_PROGRESSITEM& item) {
+        double now = elapsed();
+
+        if (item.state == FSBANK_STATE_WARNING) {
+            auto warning = static_cast<const FSBANK_STATEDATA_WARNING*>(item.stateData);
+            if (namesRestored && warning->warnCode == FSBANK_WARN_FORCED_DONTWRITENAMES) {
+                return;
+            }
+            warnings.push_back(subsoundName(item.subSoundIndex) + ": " + warning->warningString);
+            return;
+        }
+
+        auto open = openSpans.find(item.subSoundIndex);
+        if (open != openSpans.end()) {
+            open->second.end = now;
+            spans.push_back(open->second);
+            openSpans.erase(open);
+        }
+
+        if (item.state < FSBANK_STATE_FINISHED) {
+            openSpans[item.subSoundIndex] = { item.subSoundIndex, item.threadIndex, item.state, now, now };
+        }
+        else if (item.subSoundIndex >= 0) {
+            ++completed;
+            if (item.state == FSBANK_STATE_FAILED) {
+                auto failed = static_cast<const FSBANK_STATEDATA_FAILED*>(item.stateData);
+                warnings.push_back(subsoundName(item.subSoundIndex) + " failed: " + failed->errorString);
+            }
+        }
+    }
+
+    void printWarnings() {
+        for (const auto& warning : warnings) {
+            std::wcout << L"\r" << boost::nowide::widen(warning) << std::endl;
+        }
+        warnings.clear();
+    }
+
+    void printStatus() {
+        printWarnings();
+
+        int active[FSBANK_STATE_FINISHED] = {};
+        for (const auto& open : openSpans) {
+            ++active[open.second.state];
+        }
+
+        std::wcout << L"\r[" << completed << L"/" << names.size() << L"] " << static_cast<int>(elapsed()) << L"s";
+        for (int state = 0; state < FSBANK_STATE_FINISHED; ++state) {
+            if (active[state]) {
+                std::wcout << L"  " << stateName(state) << L" " << active[state];
+            }
+        }
+        std::wcout << L"        " << std::flush;
+    }
+
+    const std::vector<std::string>& names;
+    bool live;
+    bool namesRestored;
+    std::chrono::steady_clock::time_point begin;
+    std::atomic<bool> running = false;
+    std::thread poller;
+
+    // Only touched by the poller until stop() joins it
+    std::map<int, Span> openSpans;
+    std::vector<Span> spans;
+    std::vector<std::string> warnings;
+    size_t completed = 0;
+};
+
+
+} // namespace
+
+FSBANK_RESULT BankBuilder::build(const fs::path& outputPath) {
+    FSBANK_RESULT result;
+
+    // Encoded subsounds are cached here, so a cancelled build picks up where it stopped
+    fs::path cacheDirectory = this->cacheDirectory;
+    if (cacheDirectory.empty()) {
+        cacheDirectory = outputPath.parent_path() / (outputPath.stem().wstring() + L".fsbcache");
+    }
+    fs::create_directories(cacheDirectory);
+    std::string utf8CacheDirectory = boost::nowide::narrow(cacheDirectory.wstring());
+
+    result = FSBank_MemoryInit(fsbankAlloc, fsbankRealloc, fsbankFree);
+    if (result != FSBANK_OK) {
+        return result;
+    }
+
+    //Init FSBank
+    result = FSBank_Init(FSBANK_FSBVERSION_FSB5, FSBANK_INIT_GENERATEPROGRESSITEMS, jobs, utf8CacheDirectory.c_str());
+    if (result != FSBANK_OK) {
+        return result;
+    }
+
+    //vector array of soundbanks (for each file)
+    std::vector<FSBANK_SUBSOUND> subsounds(files.size());
+    //ptrs for the converted strings, sized up front so subsounds can point into it
+    std::vector<const char*> cfileNames(files.size());
+    std::vector<const void*> fileData(files.size());
+    std::vector<unsigned int> fileDataLengths(files.size());
+    std::vector<std::string> names(files.size());
+    bool fromMemory = false;
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        cfileNames[i] = files[i].c_str();
+        names[i] = boost::nowide::narrow(fs::path(boost::nowide::widen(files[i])).stem().wstring());
+
+        subsounds[i] = {};
+        if (images[i].empty()) {
+            subsounds[i].fileNames = &cfileNames[i];
+        }
+        else {
+            fileData[i] = images[i].data();
+            fileDataLengths[i] = static_cast<unsigned int>(images[i].size());
+            subsounds[i].fileData = &fileData[i];
+            subsounds[i].fileDataLengths = &fileDataLengths[i];
+            fromMemory = true;
+        }
+        subsounds[i].numFiles = 1;
+        subsounds[i].overrideFlags = FSBANK_BUILD_DISABLESYNCPOINTS;
+    }
+
+    std::string utf8OutputPath = boost::nowide::narrow(outputPath.wstring());
+    BuildProgress buildProgress(names, progress, fromMemory);
+    buildProgress.start();
+    result = FSBank_Build(subsounds.data(), static_cast<unsigned int>(subsounds.size()), FSBANK_FORMAT_VORBIS, FSBANK_BUILD_DEFAULT | FSBANK_BUILD_DONTLOOP, 100, nullptr, utf8OutputPath.c_str());
+    buildProgress.stop();
+
+    if (result != FSBANK_OK) {
+        boost::system::error_code ec;
+        fs::remove(outputPath, ec);
+        FSBank_Release();
+        if (result == FSBANK_ERR_CANCELLED) {
+            std::wcout << L"Build cancelled, finished subsounds are cached in " << cacheDirectory.wstring() << std::endl;
+        }
+        return result;
+    }
+
+    if (fromMemory && !writeFSB5Names(outputPath, names)) {
+        std::wcerr << L"Failed to write subsound names to " << outputPath.wstring() << std::endl;
+    }
+
+    buildProgress.printSummary();
+    if (!tracePath.empty()) {
+        buildProgress.writeTrace(tracePath);
+    }
+
+    unsigned int currentAllocated = 0;
+    unsigned int maximumAllocated = 0;
+    result = FSBank_MemoryGetStats(&currentAllocated, &maximumAllocated);
+    ERRCHECK(result);
+
+    result = FSBank_Release();
+    ERRCHECK(result);
+
+    std::wcout << L"FSBank reported: current " << currentAllocated / 1024 << L" KB, peak " << maximumAllocated / 1024 << L" KB" << std::endl;
+    fsbankPool.report();
+    return FSBANK_OK;
+}
+
+} // namespace fsbtool
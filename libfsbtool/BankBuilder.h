@@ -0,0 +1,48 @@
+﻿#pragma once
+
+// FSBANK headers
+#include "FSBANK/fsbank.h"
+
+// Standard C++ headers
+#include <string>
+#include <vector>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+// Collects source files and builds them into one Vorbis FSB5 bank. FSBank is a process-wide
+// singleton, so only one builder may be building at a time.
+class BankBuilder {
+public:
+    void addFile(const std::string& utf8Path) { files.push_back(utf8Path); images.emplace_back(); }
+    // Builds the subsound from an in-memory image of a sound file, named after utf8Path. FSBank
+    // drops the names of such subsounds, so build() writes the name table back afterwards.
+    void addImage(const std::string& utf8Path, std::vector<char> image) { files.push_back(utf8Path); images.push_back(std::move(image)); }
+    size_t size() const { return files.size(); }
+
+    void setJobs(unsigned int value) { jobs = value; }
+    // Defaults to <output stem>.fsbcache beside the bank
+    void setCacheDirectory(const fs::path& value) { cacheDirectory = value; }
+    // Shows the live status line; the summary and warnings are printed either way
+    void setProgress(bool value) { progress = value; }
+    void setTracePath(const fs::path& value) { tracePath = value; }
+
+    // Returns FSBANK_ERR_CANCELLED when shouldCancel() fired, after removing the partial bank.
+    // Subsounds finished before that stay in the cache for the next build.
+    FSBANK_RESULT build(const fs::path& outputPath);
+
+private:
+    std::vector<std::string> files;
+    // Empty where the subsound is read from its file
+    std::vector<std::vector<char>> images;
+    unsigned int jobs = 1;
+    fs::path cacheDirectory;
+    fs::path tracePath;
+    bool progress = true;
+};
+
+} // namespace fsbtool
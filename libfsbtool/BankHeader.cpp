@@ -0,0 +1,163 @@
+﻿#include "BankHeader.h"
+
+// Standard C++ headers
+#include <cstring>
+
+// Boost libraries
+#include <boost/filesystem/fstream.hpp>
+
+namespace fsbtool {
+
+bool parseFSB5Header(const unsigned char* data, size_t size, BankHeader& header) {
+    auto u32 = [&](size_t offset) {
+        uint32_t value;
+        memcpy(&value, data + offset, sizeof(value));
+        return value;
+    };
+
+    if (size < 0x3C || memcmp(data, "FSB5", 4) != 0) {
+        return false;
+    }
+
+    header.version = u32(0x04);
+    unsigned int numSubsounds = u32(0x08);
+    uint64_t sampleHeadersSize = u32(0x0C);
+    uint64_t nameTableSize = u32(0x10);
+    header.dataSize = u32(0x14);
+    header.mode = u32(0x18);
+
+    uint64_t baseSize = header.version == 0 ? 0x40 : 0x3C;
+    uint64_t sampleHeadersEnd = baseSize + sampleHeadersSize;
+    header.headerSize = sampleHeadersEnd + nameTableSize;
+    if (size < header.headerSize || numSubsounds > sampleHeadersSize / 8) {
+        return false;
+    }
+
+    static const unsigned int rates[] = { 4000, 8000, 11000, 11025, 16000, 22050, 24000, 32000, 44100, 48000, 96000 };
+    static const unsigned int channelCounts[] = { 1, 2, 6, 8 };
+
+    header.subsounds.assign(numSubsounds, SubsoundHeader());
+    uint64_t offset = baseSize;
+    for (auto& subsound : header.subsounds) {
+        if (offset + 8 > sampleHeadersEnd) {
+            return false;
+        }
+
+        uint32_t mode1 = u32(offset);
+        uint32_t mode2 = u32(offset + 4);
+        offset += 8;
+
+        unsigned int rateIndex = (mode1 >> 1) & 0x0F;
+        subsound.rate = rateIndex < 11 ? rates[rateIndex] : 0;
+        subsound.channels = channelCounts[(mode1 >> 5) & 0x03];
+        subsound.dataOffset = ((static_cast<uint64_t>(mode2 & 0x03) << 25) | ((mode1 >> 7) & 0x1FFFFFF)) << 5;
+        subsound.lengthPCM = (mode2 >> 2) & 0x3FFFFFFF;
+
+        // Optional chunks, some of which override the packed channel count and rate
+        bool moreChunks = mode1 & 0x01;
+        while (moreChunks) {
+            if (offset + 4 > sampleHeadersEnd) {
+                return false;
+            }
+
+            uint32_t chunk = u32(offset);
+            uint32_t chunkSize = (chunk >> 1) & 0xFFFFFF;
+            uint32_t chunkType = (chunk >> 25) & 0x7F;
+            moreChunks = chunk & 0x01;
+            offset += 4;
+
+            if (offset + chunkSize > sampleHeadersEnd) {
+                return false;
+            }
+            if (chunkType == 1 && chunkSize >= 1) {
+                subsound.channels = data[offset];
+            }
+            else if (chunkType == 2 && chunkSize >= 4) {
+                subsound.rate = u32(offset);
+            }
+            offset += chunkSize;
+        }
+    }
+
+    for (size_t i = 0; i < header.subsounds.size(); ++i) {
+        uint64_t end = i + 1 < header.subsounds.size() ? header.subsounds[i + 1].dataOffset : header.dataSize;
+        header.subsounds[i].compressedSize = end > header.subsounds[i].dataOffset ? end - header.subsounds[i].dataOffset : 0;
+    }
+
+    if (nameTableSize >= numSubsounds * 4ull) {
+        for (size_t i = 0; i < header.subsounds.size(); ++i) {
+            uint64_t nameOffset = sampleHeadersEnd + u32(sampleHeadersEnd + i * 4);
+            if (nameOffset < header.headerSize) {
+                const char* name = reinterpret_cast<const char*>(data + nameOffset);
+                header.subsounds[i].name.assign(name, strnlen(name, static_cast<size_t>(header.headerSize - nameOffset)));
+            }
+        }
+    }
+
+    return true;
+}
+
+bool readBankHeader(const fs::path& bankPath, BankHeader& header, uint64_t offset) {
+    fs::ifstream bank(bankPath, std::ios::binary);
+    bank.seekg(static_cast<std::streamoff>(offset));
+    std::vector<unsigned char> data(0x40);
+    if (!bank.read(reinterpret_cast<char*>(data.data()), data.size())) {
+        return false;
+    }
+
+    uint32_t sampleHeadersSize;
+    uint32_t nameTableSize;
+    memcpy(&sampleHeadersSize, data.data() + 0x0C, sizeof(sampleHeadersSize));
+    memcpy(&nameTableSize, data.data() + 0x10, sizeof(nameTableSize));
+
+    data.resize(0x40 + static_cast<size_t>(sampleHeadersSize) + nameTableSize);
+    bank.read(reinterpret_cast<char*>(data.data()) + 0x40, data.size() - 0x40);
+    return parseFSB5Header(data.data(), 0x40 + static_cast<size_t>(bank.gcount()), header);
+}
+
+bool writeFSB5Names(const fs::path& bankPath, const std::vector<std::string>& names) {
+    BankHeader header;
+    if (!readBankHeader(bankPath, header) || header.subsounds.size() != names.size()) {
+        return false;
+    }
+
+    fs::ifstream bank(bankPath, std::ios::binary);
+    std::vector<char> data(static_cast<size_t>(header.headerSize));
+    if (!bank.read(data.data(), data.size())) {
+        return false;
+    }
+    uint32_t sampleHeadersSize;
+    memcpy(&sampleHeadersSize, data.data() + 0x0C, sizeof(sampleHeadersSize));
+    size_t sampleHeadersEnd = (header.version == 0 ? 0x40 : 0x3C) + static_cast<size_t>(sampleHeadersSize);
+
+    // Offsets from the start of the table, then the NUL terminated names, padded so the data
+    // keeps the 32 byte alignment FSBank gives it
+    std::vector<char> table(names.size() * 4);
+    for (size_t i = 0; i < names.size(); ++i) {
+        uint32_t offset = static_cast<uint32_t>(table.size());
+        memcpy(table.data() + i * 4, &offset, sizeof(offset));
+        table.insert(table.end(), names[i].begin(), names[i].end());
+        table.push_back('\0');
+    }
+    table.resize((sampleHeadersEnd + table.size() + 31) / 32 * 32 - sampleHeadersEnd, '\0');
+    uint32_t nameTableSize = static_cast<uint32_t>(table.size());
+    memcpy(data.data() + 0x10, &nameTableSize, sizeof(nameTableSize));
+
+    fs::path partPath = bankPath.wstring() + L".part";
+    {
+        fs::ofstream part(partPath, std::ios::binary | std::ios::trunc);
+        part.write(data.data(), static_cast<std::streamsize>(sampleHeadersEnd));
+        part.write(table.data(), static_cast<std::streamsize>(table.size()));
+        if (bank.peek() != std::char_traits<char>::eof()) {
+            part << bank.rdbuf();
+        }
+        if (!part) {
+            return false;
+        }
+    }
+    bank.close();
+    fs::rename(partPath, bankPath);
+    return true;
+}
+
+} // namespace fsbtool
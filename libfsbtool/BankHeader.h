@@ -0,0 +1,54 @@
+﻿#pragma once
+
+// Standard C++ headers
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+struct SubsoundHeader {
+    unsigned int lengthPCM = 0;
+    unsigned int channels = 0;
+    unsigned int rate = 0;
+    uint64_t dataOffset = 0;
+    uint64_t compressedSize = 0;
+    std::string name;
+};
+
+struct BankHeader {
+    unsigned int version = 0;
+    unsigned int mode = 0;
+    uint64_t headerSize = 0;
+    uint64_t dataSize = 0;
+    std::vector<SubsoundHeader> subsounds;
+};
+
+// Reads the FSB5 sample headers and name table directly, so a subsound's length and compressed
+// size are known without asking FMOD to open or decode anything. Offsets are relative to the
+// start of the data section, which begins at headerSize.
+bool parseFSB5Header(const unsigned char* data, size_t size, BankHeader& header);
+// offset is where the bank starts in the file, for banks embedded in a larger container
+bool readBankHeader(const fs::path& bankPath, BankHeader& header, uint64_t offset = 0);
+// Rewrites the name table of a bank with one name per subsound, leaving the sample headers and
+// data as they are. FSBank writes no names for subsounds built from memory.
+bool writeFSB5Names(const fs::path& bankPath, const std::vector<std::string>& names);
+
+// Predicted export time for a subsound. Decoding scales with output samples and reading with the
+// compressed size. The constants are rough Vorbis figures; only their ratio matters for ordering,
+// and --cost-report shows how far off they are.
+struct CostModel {
+    double secondsPerSample = 2.5e-8;
+    double secondsPerByte = 2.0e-9;
+
+    double predict(const SubsoundHeader& subsound) const {
+        return static_cast<double>(subsound.lengthPCM) * subsound.channels * secondsPerSample + subsound.compressedSize * secondsPerByte;
+    }
+};
+
+} // namespace fsbtool
@@ -0,0 +1,280 @@
+﻿#include "BankReader.h"
+#include "FileCache.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+// Boost libraries
+#include <boost/nowide/convert.hpp>
+
+namespace fsbtool {
+
+void convertToFloat(const void* data, FMOD_SOUND_FORMAT format, size_t samples, float* buffer) {
+    if (format == FMOD_SOUND_FORMAT_PCMFLOAT) {
+        memcpy(buffer, data, samples * sizeof(float));
+        return;
+    }
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < samples; ++i) {
+        switch (format) {
+        case FMOD_SOUND_FORMAT_PCM8:
+            buffer[i] = static_cast<int8_t>(bytes[i]) / 128.0f;
+            break;
+        case FMOD_SOUND_FORMAT_PCM16: {
+            int16_t sample;
+            memcpy(&sample, bytes + i * 2, sizeof(sample));
+            buffer[i] = sample / 32768.0f;
+            break;
+        }
+        case FMOD_SOUND_FORMAT_PCM24: {
+            const unsigned char* p = bytes + i * 3;
+            int32_t sample = static_cast<int32_t>((p[0] << 8) | (p[1] << 16) | (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+            buffer[i] = sample / 8388608.0f;
+            break;
+        }
+        case FMOD_SOUND_FORMAT_PCM32: {
+            int32_t sample;
+            memcpy(&sample, bytes + i * 4, sizeof(sample));
+            buffer[i] = static_cast<float>(sample / 2147483648.0);
+            break;
+        }
+        default:
+            buffer[i] = 0.0f;
+            break;
+        }
+    }
+}
+
+SubsoundDecoder::~SubsoundDecoder() {
+    close();
+}
+
+SubsoundDecoder::SubsoundDecoder(SubsoundDecoder&& other) noexcept {
+    *this = std::move(other);
+}
+
+SubsoundDecoder& SubsoundDecoder::operator=(SubsoundDecoder&& other) noexcept {
+    if (this != &other) {
+        close();
+        bankPath = std::move(other.bankPath);
+        bankOffset = other.bankOffset;
+        parent = std::exchange(other.parent, nullptr);
+        sound = std::exchange(other.sound, nullptr);
+        format = other.format;
+        lengthPCM = other.lengthPCM;
+        position = other.position;
+        channels = other.channels;
+        rate = other.rate;
+        bits = other.bits;
+        scratch = std::move(other.scratch);
+    }
+    return *this;
+}
+
+FMOD_RESULT SubsoundDecoder::read(void* buffer, unsigned int maxFrames, unsigned int* framesRead) {
+    unsigned int frameBytes = channels * bits / 8;
+    unsigned int bytesRead = 0;
+    *framesRead = 0;
+
+    if (!sound || frameBytes == 0) {
+        return FMOD_ERR_INVALID_HANDLE;
+    }
+    if (position >= lengthPCM || maxFrames == 0) {
+        return FMOD_ERR_FILE_EOF;
+    }
+
+    maxFrames = std::min(maxFrames, lengthPCM - position);
+    FMOD_RESULT result = sound->readData(buffer, maxFrames * frameBytes, &bytesRead);
+    *framesRead = bytesRead / frameBytes;
+    position += *framesRead;
+
+    if (result == FMOD_ERR_FILE_EOF && *framesRead > 0) {
+        return FMOD_OK;
+    }
+    return result;
+}
+
+FMOD_RESULT SubsoundDecoder::readFloat(float* buffer, unsigned int maxFrames, unsigned int* framesRead) {
+    if (format == FMOD_SOUND_FORMAT_PCMFLOAT) {
+        return read(buffer, maxFrames, framesRead);
+    }
+
+    scratch.resize(static_cast<size_t>(maxFrames) * channels * bits / 8);
+    FMOD_RESULT result = read(scratch.data(), maxFrames, framesRead);
+
+    convertToFloat(scratch.data(), format, static_cast<size_t>(*framesRead) * channels, buffer);
+    return result;
+}
+
+FMOD_RESULT SubsoundDecoder::seek(unsigned int frame) {
+    if (!sound) {
+        return FMOD_ERR_INVALID_HANDLE;
+    }
+
+    FMOD_RESULT result = sound->seekData(std::min(frame, lengthPCM));
+    if (result == FMOD_OK) {
+        position = std::min(frame, lengthPCM);
+    }
+    return result;
+}
+
+void SubsoundDecoder::close() {
+    if (parent) {
+        parent->release();
+    }
+    parent = nullptr;
+    sound = nullptr;
+    bankPath.clear();
+}
+
+BankReader::BankReader(FMOD::System* system) : system(system) {
+}
+
+BankReader::~BankReader() {
+    close();
+    if (ownsSystem) {
+        system->release();
+    }
+}
+
+FMOD_RESULT BankReader::open(const fs::path& bankPath, uint64_t offset, uint64_t length) {
+    FMOD_RESULT result;
+    close();
+
+    if (offset > UINT_MAX || length > UINT_MAX) {
+        return FMOD_ERR_FILE_COULDNOTSEEK;
+    }
+    fileOffset = static_cast<unsigned int>(offset);
+    fileLength = static_cast<unsigned int>(length);
+
+    if (!system) {
+        result = FMOD::System_Create(&system);
+        if (result != FMOD_OK) {
+            return result;
+        }
+        ownsSystem = true;
+
+        result = readAheadFiles.install(system);
+        if (result != FMOD_OK) {
+            return result;
+        }
+        system->setOutput(FMOD_OUTPUTTYPE_NOSOUND_NRT);
+        result = system->init(32, FMOD_INIT_NORMAL, nullptr);
+        if (result != FMOD_OK) {
+            return result;
+        }
+    }
+
+    FMOD::Sound* parent = nullptr;
+    path = bankPath;
+    utf8Path = boost::nowide::narrow(bankPath.wstring());
+    result = openStream(0, &parent);
+    if (result != FMOD_OK) {
+        utf8Path.clear();
+        return result;
+    }
+
+    int numSubSounds = 0;
+    parent->getNumSubSounds(&numSubSounds);
+
+    BankHeader header;
+    bool haveHeader = readBankHeader(bankPath, header, offset) && static_cast<int>(header.subsounds.size()) == numSubSounds;
+    subsounds = haveHeader ? header.subsounds : std::vector<SubsoundHeader>(numSubSounds);
+
+    // Anything the FSB5 header could not tell us, including names of banks built without them,
+    // comes from FMOD
+    for (int i = 0; i < numSubSounds; ++i) {
+        SubsoundHeader& subsound = subsounds[i];
+        FMOD::Sound* fmodSubsound = nullptr;
+        if ((!haveHeader || subsound.name.empty()) && parent->getSubSound(i, &fmodSubsound) == FMOD_OK) {
+            std::vector<char> name(256);
+            if (fmodSubsound->getName(name.data(), static_cast<int>(name.size())) == FMOD_OK) {
+                subsound.name = name.data();
+            }
+
+            if (!haveHeader) {
+                int channels = 0;
+                float rate = 0.0f;
+                fmodSubsound->getLength(&subsound.lengthPCM, FMOD_TIMEUNIT_PCM);
+                fmodSubsound->getFormat(nullptr, nullptr, &channels, nullptr);
+                fmodSubsound->getDefaults(&rate, nullptr);
+                subsound.channels = channels;
+                subsound.rate = static_cast<unsigned int>(rate);
+            }
+        }
+        byName.emplace(subsound.name, i);
+    }
+
+    parent->release();
+    return FMOD_OK;
+}
+
+void BankReader::close() {
+    path.clear();
+    utf8Path.clear();
+    fileOffset = 0;
+    fileLength = 0;
+    subsounds.clear();
+    byName.clear();
+}
+
+int BankReader::findSubsound(const std::string& nameOrIndex) const {
+    auto named = byName.find(nameOrIndex);
+    if (named != byName.end()) {
+        return named->second;
+    }
+
+    char* end = nullptr;
+    long index = strtol(nameOrIndex.c_str(), &end, 10);
+    return !nameOrIndex.empty() && *end == 0 && index >= 0 && index < getNumSubsounds() ? static_cast<int>(index) : -1;
+}
+
+FMOD_RESULT BankReader::openStream(int index, FMOD::Sound** parent) const {
+    FMOD_CREATESOUNDEXINFO exinfo = {};
+    exinfo.cbsize = sizeof(exinfo);
+    exinfo.initialsubsound = index;
+    exinfo.fileoffset = fileOffset;
+    exinfo.length = fileLength;
+    return system->createSound(utf8Path.c_str(), FMOD_CREATESTREAM | FMOD_OPENONLY, &exinfo, parent);
+}
+
+FMOD_RESULT BankReader::openDecoder(int index, SubsoundDecoder& decoder) const {
+    FMOD_RESULT result;
+
+    if (index < 0 || index >= getNumSubsounds()) {
+        decoder.close();
+        return FMOD_ERR_INVALID_PARAM;
+    }
+
+    if (!decoder.parent || decoder.bankPath != utf8Path || decoder.bankOffset != fileOffset) {
+        decoder.close();
+        result = openStream(index, &decoder.parent);
+        if (result != FMOD_OK) {
+            return result;
+        }
+        decoder.bankPath = utf8Path;
+        decoder.bankOffset = fileOffset;
+    }
+
+    result = decoder.parent->getSubSound(index, &decoder.sound);
+    if (result != FMOD_OK) {
+        decoder.close();
+        return result;
+    }
+
+    float rate = 0.0f;
+    decoder.sound->getLength(&decoder.lengthPCM, FMOD_TIMEUNIT_PCM);
+    decoder.sound->getFormat(nullptr, &decoder.format, &decoder.channels, &decoder.bits);
+    decoder.sound->getDefaults(&rate, nullptr);
+    decoder.rate = static_cast<int>(rate);
+    decoder.position = 0;
+    return FMOD_OK;
+}
+
+} // namespace fsbtool
@@ -0,0 +1,109 @@
+﻿#pragma once
+
+#include "BankHeader.h"
+
+// FMOD headers
+#include "FMOD/fmod.hpp"
+
+// Standard C++ headers
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+// Converts interleaved PCM in any FMOD PCM format to float in [-1, 1]
+void convertToFloat(const void* data, FMOD_SOUND_FORMAT format, size_t samples, float* buffer);
+
+// Pull based decoder for one subsound. Each decoder owns its own FMOD stream of the bank,
+// so several decoders can run on separate threads. Reopening a decoder on another subsound of
+// the same bank reuses that stream instead of parsing the bank header again.
+class SubsoundDecoder {
+public:
+    SubsoundDecoder() = default;
+    ~SubsoundDecoder();
+
+    SubsoundDecoder(const SubsoundDecoder&) = delete;
+    SubsoundDecoder& operator=(const SubsoundDecoder&) = delete;
+    SubsoundDecoder(SubsoundDecoder&& other) noexcept;
+    SubsoundDecoder& operator=(SubsoundDecoder&& other) noexcept;
+
+    bool isOpen() const { return sound != nullptr; }
+    unsigned int getLength() const { return lengthPCM; }
+    unsigned int getPosition() const { return position; }
+    int getChannels() const { return channels; }
+    int getRate() const { return rate; }
+    int getBits() const { return bits; }
+    FMOD_SOUND_FORMAT getFormat() const { return format; }
+
+    // Decodes up to maxFrames frames in the subsound's own sample format. Returns
+    // FMOD_ERR_FILE_EOF once nothing is left.
+    FMOD_RESULT read(void* buffer, unsigned int maxFrames, unsigned int* framesRead);
+
+    // As read(), converted to interleaved float in [-1, 1]
+    FMOD_RESULT readFloat(float* buffer, unsigned int maxFrames, unsigned int* framesRead);
+
+    FMOD_RESULT seek(unsigned int frame);
+    void close();
+
+private:
+    friend class BankReader;
+
+    std::string bankPath;
+    unsigned int bankOffset = 0;
+    FMOD::Sound* parent = nullptr;
+    FMOD::Sound* sound = nullptr;
+    FMOD_SOUND_FORMAT format = FMOD_SOUND_FORMAT_NONE;
+    unsigned int lengthPCM = 0;
+    unsigned int position = 0;
+    int channels = 0;
+    int rate = 0;
+    int bits = 0;
+    std::vector<char> scratch;
+};
+
+// Opens a bank once and keeps its subsound table and name index. Pass a System to share one
+// between readers, otherwise the reader creates its own.
+class BankReader {
+public:
+    explicit BankReader(FMOD::System* system = nullptr);
+    ~BankReader();
+
+    BankReader(const BankReader&) = delete;
+    BankReader& operator=(const BankReader&) = delete;
+
+    // A non-zero length opens the bank embedded at offset inside a larger file. FMOD takes
+    // 32 bit offsets, so the bank must start in the first 4 GB.
+    FMOD_RESULT open(const fs::path& bankPath, uint64_t offset = 0, uint64_t length = 0);
+    void close();
+
+    bool isOpen() const { return !utf8Path.empty(); }
+    const fs::path& getPath() const { return path; }
+    FMOD::System* getSystem() const { return system; }
+    int getNumSubsounds() const { return static_cast<int>(subsounds.size()); }
+    const SubsoundHeader& getSubsound(int index) const { return subsounds[index]; }
+
+    // Accepts a subsound name or a decimal index, returns -1 when neither matches
+    int findSubsound(const std::string& nameOrIndex) const;
+
+    FMOD_RESULT openDecoder(int index, SubsoundDecoder& decoder) const;
+
+private:
+    FMOD_RESULT openStream(int index, FMOD::Sound** parent) const;
+
+    FMOD::System* system = nullptr;
+    bool ownsSystem = false;
+    fs::path path;
+    std::string utf8Path;
+    unsigned int fileOffset = 0;
+    unsigned int fileLength = 0;
+    std::vector<SubsoundHeader> subsounds;
+    std::unordered_map<std::string, int> byName;
+};
+
+} // namespace fsbtool
@@ -0,0 +1,75 @@
+﻿#include "Common.h"
+#include "PcmHasher.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+// Boost libraries
+#include <boost/filesystem/fstream.hpp>
+#include <boost/algorithm/string.hpp>
+
+namespace fsbtool {
+
+std::atomic<bool> cancelRequested = false;
+std::chrono::steady_clock::time_point cancelDeadline = std::chrono::steady_clock::time_point::max();
+
+void requestCancel() {
+    cancelRequested = true;
+}
+
+bool shouldCancel() {
+    if (!cancelRequested && std::chrono::steady_clock::now() >= cancelDeadline) {
+        cancelRequested = true;
+    }
+    return cancelRequested;
+}
+
+void ERRCHECK(FMOD_RESULT result) {
+#ifdef _DEBUG
+    if (result != FMOD_OK) {
+        wprintf(L"FMOD error! (%d) %s\n", result, FMOD_WErrorString(result));
+        exit(-1);
+    }
+#endif
+}
+
+void ERRCHECK(FSBANK_RESULT result) {
+#ifdef _DEBUG
+    if (result != FSBANK_OK) {
+        wprintf(L"FSBANK error! (%d) %s\n", result, FSBank_WErrorString(result));
+        exit(-1);
+    }
+#endif
+}
+
+bool hashFile(const fs::path& path, uint64_t& size, uint64_t& hash) {
+    fs::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    PcmHasher hasher;
+    std::vector<char> buffer(1024 * 1024);
+    size = 0;
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+        hasher.update(buffer.data(), static_cast<size_t>(file.gcount()));
+        size += file.gcount();
+    }
+    hash = hasher.digest();
+    return true;
+}
+
+std::vector<fs::path> findFiles(const fs::path& root, const std::string& extension) {
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::recursive_directory_iterator(root)) {
+        if (entry.status().type() == fs::regular_file && boost::algorithm::to_lower_copy(entry.path().extension().string()) == extension) {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+} // namespace fsbtool
@@ -0,0 +1,40 @@
+﻿#pragma once
+
+// FMOD headers
+#include "FMOD/fmod.hpp"
+#include "FMOD/fmod_errors.h"
+
+// FSBANK headers
+#include "FSBANK/fsbank.h"
+#include "FSBANK/fsbank_errors.h"
+
+// Standard C++ headers
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+// Set by requestCancel() or once cancelDeadline passes. Long running work polls shouldCancel()
+// and stops at the next subsound boundary.
+extern std::atomic<bool> cancelRequested;
+extern std::chrono::steady_clock::time_point cancelDeadline;
+
+// Safe to call from a signal handler
+void requestCancel();
+bool shouldCancel();
+
+void ERRCHECK(FMOD_RESULT result);
+void ERRCHECK(FSBANK_RESULT result);
+
+bool hashFile(const fs::path& path, uint64_t& size, uint64_t& hash);
+std::vector<fs::path> findFiles(const fs::path& root, const std::string& extension);
+
+} // namespace fsbtool
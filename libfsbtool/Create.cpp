@@ -0,0 +1,639 @@
+﻿#include "Create.h"
+#include "BankBuilder.h"
+#include "BankReader.h"
+#include "Common.h"
+#include "Loudness.h"
+#include "PcmHasher.h"
+#include "Wav.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+// Boost libraries
+#include <boost/filesystem/fstream.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/nowide/convert.hpp>
+#include <boost/locale.hpp>
+#include <boost/process.hpp>
+#include <boost/dll/runtime_symbol_info.hpp>
+
+namespace fsbtool {
+
+namespace bp = boost::process;
+
+namespace {
+
+// Rough Vorbis output at quality 100, in bytes per sample per channel. Only used to balance shards.
+constexpr double kVorbisBytesPerSample = 0.7;
+
+// Normalisation never raises a source's sample peak above this, in dBFS
+constexpr double kPeakCeilingDb = -1.0;
+
+// Normalised images all stay in memory until FSBank has built the bank, so their total is capped
+constexpr uint64_t kMaxNormalisedBytes = 1024ull * 1024 * 1024;
+
+struct SourceEntry {
+    std::string path;
+    std::string name;
+    uint64_t estimatedSize = 0;
+    unsigned int frames = 0;
+    int channels = 0;
+    float rate = 0.0f;
+    uint64_t pcmHash = 0;
+};
+
+std::vector<std::wstring> readFileList(const fs::path& filePath) {
+    std::vector<std::wstring> fileNames;
+    std::string ext = boost::algorithm::to_lower_copy(filePath.extension().string());
+
+    if (ext == ".txt" || ext == ".lst") {
+        std::wifstream fileList(filePath.string());
+        if (!fileList) {
+            std::cerr << "Failed to open file list: " << filePath << "\n";
+            return fileNames;
+        }
+
+        fileList.imbue(boost::locale::generator().generate("en_US.UTF-8"));
+
+        std::wstring line;
+        while (std::getline(fileList, line)) {
+            if (!line.empty()) {
+                fileNames.push_back(boost::filesystem::path(line).wstring());
+            }
+        }
+    }
+    else {
+        fileNames.push_back(filePath.wstring());
+    }
+
+    return fileNames;
+}
+
+std::vector<SourceEntry> probeSources(const std::vector<std::wstring>& fileNames, bool hashPCM, unsigned int jobs) {
+    FMOD::System* system = nullptr;
+    FMOD_RESULT result;
+
+    result = FMOD::System_Create(&system);
+    ERRCHECK(result);
+
+    result = system->setOutput(FMOD_OUTPUTTYPE_NOSOUND_NRT);
+    ERRCHECK(result);
+
+    result = system->init(1, FMOD_INIT_NORMAL, nullptr);
+    ERRCHECK(result);
+
+    std::vector<SourceEntry> sources(fileNames.size());
+    std::atomic<size_t> nextSource = 0;
+
+    auto probe = [&]() {
+        std::vector<char> buffer(hashPCM ? 256 * 1024 : 0);
+
+        for (size_t i = nextSource++; i < fileNames.size(); i = nextSource++) {
+            SourceEntry& source = sources[i];
+            source.path = boost::nowide::narrow(fs::absolute(fileNames[i]).wstring());
+            source.name = boost::nowide::narrow(fs::path(fileNames[i]).stem().wstring());
+
+            FMOD::Sound* sound = nullptr;
+            if (system->createSound(source.path.c_str(), FMOD_OPENONLY, nullptr, &sound) != FMOD_OK) {
+                std::wcerr << L"Failed to open source: " << fileNames[i] << std::endl;
+                continue;
+            }
+
+            sound->getLength(&source.frames, FMOD_TIMEUNIT_PCM);
+            sound->getFormat(nullptr, nullptr, &source.channels, nullptr);
+            sound->getDefaults(&source.rate, nullptr);
+            source.estimatedSize = static_cast<uint64_t>(static_cast<double>(source.frames) * source.channels * kVorbisBytesPerSample);
+
+            if (hashPCM) {
+                PcmHasher hasher;
+                unsigned int read = 0;
+                FMOD_RESULT readResult;
+                do {
+                    readResult = sound->readData(buffer.data(), static_cast<unsigned int>(buffer.size()), &read);
+                    hasher.update(buffer.data(), read);
+                } while (readResult == FMOD_OK && read > 0);
+                source.pcmHash = hasher.digest();
+            }
+
+            sound->release();
+        }
+    };
+
+    // FMOD's Core API is thread safe, so the workers share one System
+    std::vector<std::thread> workers;
+    for (size_t j = 1; j < std::min<size_t>(jobs, fileNames.size()); ++j) {
+        workers.emplace_back(probe);
+    }
+    probe();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    result = system->release();
+    ERRCHECK(result);
+
+    return sources;
+}
+
+// Reads a whole source as float, a block at a time
+bool decodeSource(FMOD::Sound* sound, std::vector<char>& buffer, std::vector<float>& samples, const std::function<void(const float*, unsigned int)>& sink) {
+    FMOD_SOUND_FORMAT format = FMOD_SOUND_FORMAT_NONE;
+    int channels = 0;
+    int bits = 0;
+    if (sound->getFormat(nullptr, &format, &channels, &bits) != FMOD_OK || sound->seekData(0) != FMOD_OK) {
+        return false;
+    }
+
+    unsigned int frameBytes = channels * bits / 8;
+    if (frameBytes == 0) {
+        return false;
+    }
+    unsigned int read = 0;
+    FMOD_RESULT result;
+    do {
+        result = sound->readData(buffer.data(), static_cast<unsigned int>(buffer.size() / frameBytes * frameBytes), &read);
+        samples.resize(read / frameBytes * channels);
+        convertToFloat(buffer.data(), format, samples.size(), samples.data());
+        sink(samples.data(), read / frameBytes);
+    } while (result == FMOD_OK && read > 0);
+    return result == FMOD_OK || result == FMOD_ERR_FILE_EOF;
+}
+
+// Scales float samples into 16 or 24 bit PCM with TPDF dither of one LSB
+class DitheredQuantiser {
+public:
+    DitheredQuantiser(int bits, float scale) : bits(bits), fullScale(static_cast<float>((1 << (bits - 1)) - 1) * scale), random(std::random_device()()) {}
+
+    void write(const float* samples, size_t count, char* out) {
+        float limit = static_cast<float>((1 << (bits - 1)) - 1);
+        for (size_t s = 0; s < count; ++s) {
+            float value = std::round(samples[s] * fullScale + lsb(random) - lsb(random));
+            int32_t sample = static_cast<int32_t>(std::clamp(value, -limit - 1.0f, limit));
+            if (bits == 16) {
+                int16_t narrow = static_cast<int16_t>(sample);
+                memcpy(out, &narrow, 2);
+                out += 2;
+            }
+            else {
+                out[0] = static_cast<char>(sample & 0xFF);
+                out[1] = static_cast<char>((sample >> 8) & 0xFF);
+                out[2] = static_cast<char>((sample >> 16) & 0xFF);
+                out += 3;
+            }
+        }
+    }
+
+private:
+    int bits;
+    float fullScale;
+    std::minstd_rand random;
+    std::uniform_real_distribution<float> lsb{ 0.0f, 1.0f };
+};
+
+// Two passes over each source on jobs workers sharing one System. The first measures its
+// integrated loudness and peak, the second decodes it again with the gain that brings it to
+// target, capped so the peak stays under kPeakCeilingDb, into a dithered WAV image for FSBank:
+// 16 bit for sources of 16 bits or fewer, 24 bit otherwise. Sources that fail to decode or
+// measure as silent get no image and are built unchanged. False when the images would hold more
+// than kMaxNormalisedBytes in memory.
+bool normaliseSources(const std::vector<std::string>& paths, double target, unsigned int jobs, std::vector<std::vector<char>>& images) {
+    FMOD::System* system = nullptr;
+    FMOD_RESULT result;
+
+    result = FMOD::System_Create(&system);
+    ERRCHECK(result);
+
+    result = system->setOutput(FMOD_OUTPUTTYPE_NOSOUND_NRT);
+    ERRCHECK(result);
+
+    result = system->init(1, FMOD_INIT_NORMAL, nullptr);
+    ERRCHECK(result);
+
+    images.assign(paths.size(), std::vector<char>());
+    std::vector<double> gains(paths.size(), 0.0);
+    std::atomic<size_t> nextSource = 0;
+    std::atomic<size_t> limited = 0;
+    std::atomic<uint64_t> residentBytes = 0;
+    std::atomic<bool> overBudget = false;
+
+    auto normalise = [&]() {
+        std::vector<char> buffer(256 * 1024);
+        std::vector<float> samples;
+
+        for (size_t i = nextSource++; i < paths.size() && !overBudget && !shouldCancel(); i = nextSource++) {
+            FMOD::Sound* sound = nullptr;
+            if (system->createSound(paths[i].c_str(), FMOD_OPENONLY, nullptr, &sound) != FMOD_OK) {
+                std::wcerr << L"Failed to open source: " << boost::nowide::widen(paths[i]) << std::endl;
+                continue;
+            }
+
+            WavFormat format;
+            FMOD_SOUND_FORMAT sourceFormat = FMOD_SOUND_FORMAT_NONE;
+            int sourceBits = 0;
+            float rate = 0.0f;
+            unsigned int frames = 0;
+            sound->getFormat(nullptr, &sourceFormat, &format.channels, &sourceBits);
+            sound->getDefaults(&rate, nullptr);
+            sound->getLength(&frames, FMOD_TIMEUNIT_PCM);
+            format.rate = static_cast<int>(rate);
+            format.bits = sourceBits > 16 || sourceFormat == FMOD_SOUND_FORMAT_PCMFLOAT ? 24 : 16;
+
+            LoudnessMeter meter;
+            meter.begin(format.channels, format.rate);
+            bool measured = decodeSource(sound, buffer, samples, [&](const float* data, unsigned int count) {
+                meter.add(data, count);
+            });
+            double loudness = meter.getIntegrated();
+            uint64_t imageBytes = static_cast<uint64_t>(frames) * format.frameBytes();
+            if (!measured || !std::isfinite(loudness) || imageBytes > UINT32_MAX - 64) {
+                sound->release();
+                continue;
+            }
+
+            double gain = target - loudness;
+            double headroom = kPeakCeilingDb - 20.0 * std::log10(meter.getPeak());
+            if (gain > headroom) {
+                gain = headroom;
+                ++limited;
+            }
+            gains[i] = gain;
+
+            if (residentBytes.fetch_add(imageBytes) + imageBytes > kMaxNormalisedBytes) {
+                overBudget = true;
+                sound->release();
+                break;
+            }
+
+            std::ostringstream header;
+            writeWavHeader(header, format, 0);
+            std::vector<char>& image = images[i];
+            image.reserve(header.str().size() + imageBytes);
+            image.assign(header.str().size(), 0);
+
+            DitheredQuantiser quantiser(format.bits, static_cast<float>(std::pow(10.0, gain / 20.0)));
+            bool rendered = decodeSource(sound, buffer, samples, [&](const float* data, unsigned int count) {
+                size_t offset = image.size();
+                image.resize(offset + static_cast<size_t>(count) * format.frameBytes());
+                quantiser.write(data, static_cast<size_t>(count) * format.channels, image.data() + offset);
+            });
+            sound->release();
+
+            if (!rendered || image.size() > UINT32_MAX) {
+                image.clear();
+                continue;
+            }
+            header.str("");
+            writeWavHeader(header, format, static_cast<uint32_t>(image.size() - header.str().size()));
+            std::string filled = header.str();
+            std::copy(filled.begin(), filled.end(), image.begin());
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t j = 1; j < std::min<size_t>(jobs, paths.size()); ++j) {
+        workers.emplace_back(normalise);
+    }
+    normalise();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    result = system->release();
+    ERRCHECK(result);
+
+    if (overBudget) {
+        images.clear();
+        std::wcerr << L"Normalised sources need over " << kMaxNormalisedBytes / (1024 * 1024)
+            << L" MB in memory; set --max-bank-size to build them in shards" << std::endl;
+        return false;
+    }
+
+    size_t normalised = 0;
+    double minimum = 0.0;
+    double maximum = 0.0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!images[i].empty()) {
+            minimum = normalised ? std::min(minimum, gains[i]) : gains[i];
+            maximum = normalised ? std::max(maximum, gains[i]) : gains[i];
+            ++normalised;
+        }
+    }
+    std::wcout << L"Normalised " << normalised << L" of " << paths.size() << L" sources to " << target << L" LUFS, gain "
+        << minimum << L" to " << maximum << L" dB, " << limited << L" held back by peak" << std::endl;
+    return true;
+}
+
+// Keeps the first source of every distinct decoded payload and reports or aliases the rest.
+std::vector<SourceEntry> removeDuplicates(const std::vector<SourceEntry>& sources, const fs::path& outputPath, DedupMode mode) {
+    std::vector<SourceEntry> unique;
+    std::vector<std::pair<size_t, size_t>> duplicates;
+    uint64_t savedSize = 0;
+
+    std::unordered_multimap<uint64_t, size_t> byHash;
+
+    for (size_t i = 0; i < sources.size(); ++i) {
+        const SourceEntry& source = sources[i];
+        auto range = byHash.equal_range(source.pcmHash);
+        auto original = std::find_if(range.first, range.second, [&](const auto& entry) {
+            const SourceEntry& other = unique[entry.second];
+            return other.frames == source.frames && other.channels == source.channels && other.rate == source.rate;
+        });
+
+        if (source.frames == 0 || original == range.second) {
+            byHash.emplace(source.pcmHash, unique.size());
+            unique.push_back(source);
+        }
+        else {
+            duplicates.emplace_back(i, original->second);
+            savedSize += source.estimatedSize;
+        }
+    }
+
+    if (mode == DedupMode::Alias && !duplicates.empty()) {
+        fs::path aliasPath = outputPath.parent_path() / (outputPath.stem().wstring() + L".aliases.tsv");
+        fs::ofstream aliases(aliasPath);
+        for (const auto& duplicate : duplicates) {
+            aliases << sources[duplicate.first].name << "\t" << unique[duplicate.second].name << "\n";
+        }
+        std::wcout << L"Alias map written to " << aliasPath.wstring() << std::endl;
+    }
+    else {
+        for (const auto& duplicate : duplicates) {
+            std::wcout << L"Skipped duplicate: " << boost::nowide::widen(sources[duplicate.first].path)
+                << L" (same audio as " << boost::nowide::widen(unique[duplicate.second].name) << L")" << std::endl;
+        }
+    }
+
+    std::wcout << L"Removed " << duplicates.size() << L" of " << sources.size() << L" sources as duplicates, ~"
+        << savedSize / 1024 << L" KB saved" << std::endl;
+
+    return unique;
+}
+
+// Longest-first greedy fill of the least loaded shard, adding shards until none is over the size limit.
+std::vector<std::vector<size_t>> partitionShards(const std::vector<SourceEntry>& sources, const ToolOptions& options) {
+    uint64_t totalSize = 0;
+    for (const auto& source : sources) {
+        totalSize += source.estimatedSize;
+    }
+
+    size_t maxEntries = options.maxEntries ? options.maxEntries : sources.size();
+    size_t numShards = (sources.size() + maxEntries - 1) / maxEntries;
+    if (options.maxBankSize) {
+        numShards = std::max<size_t>(numShards, (totalSize + options.maxBankSize - 1) / options.maxBankSize);
+    }
+    numShards = std::max<size_t>(numShards, 1);
+
+    std::vector<size_t> order(sources.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sources[a].estimatedSize > sources[b].estimatedSize;
+    });
+
+    while (true) {
+        std::vector<std::vector<size_t>> shards(numShards);
+        std::vector<uint64_t> shardSizes(numShards, 0);
+
+        for (size_t index : order) {
+            size_t best = numShards;
+            for (size_t s = 0; s < numShards; ++s) {
+                if (shards[s].size() < maxEntries && (best == numShards || shardSizes[s] < shardSizes[best])) {
+                    best = s;
+                }
+            }
+            shards[best].push_back(index);
+            shardSizes[best] += sources[index].estimatedSize;
+        }
+
+        bool overfull = false;
+        for (size_t s = 0; s < numShards; ++s) {
+            if (options.maxBankSize && shardSizes[s] > options.maxBankSize && shards[s].size() > 1) {
+                overfull = true;
+            }
+        }
+
+        if (!overfull || numShards >= sources.size()) {
+            for (auto& shard : shards) {
+                std::sort(shard.begin(), shard.end());
+            }
+            return shards;
+        }
+        ++numShards;
+    }
+}
+
+// FSBank is a process-wide singleton, so each shard is built by a child instance of this tool.
+// What a shard bank is built from: the options that change its contents, then the size, write
+// time and path of each source. The manifest is saved beside the bank once it builds, and a rerun
+// skips the shard only while the bank is there and the manifest still matches.
+std::string shardManifest(const std::vector<SourceEntry>& sources, const std::vector<size_t>& shard, const ToolOptions& options) {
+    std::ostringstream manifest;
+    manifest << "normalize\t" << options.normalizeLufs << "\n";
+    for (size_t index : shard) {
+        boost::system::error_code ec;
+        fs::path source = boost::nowide::widen(sources[index].path);
+        uintmax_t size = fs::file_size(source, ec);
+        std::time_t modified = fs::last_write_time(source, ec);
+        manifest << size << "\t" << modified << "\t" << sources[index].path << "\n";
+    }
+    return manifest.str();
+}
+
+// Shard lists are .lst and the index .tsv, so create-all never takes them for manifests
+bool createShardedFSB(const std::vector<SourceEntry>& sources, const fs::path& outputPath, const ToolOptions& options) {
+    auto shards = partitionShards(sources, options);
+    fs::path exePath = boost::dll::program_location();
+
+    std::vector<fs::path> listPaths(shards.size());
+    std::vector<fs::path> bankPaths(shards.size());
+    std::vector<fs::path> manifestPaths(shards.size());
+    std::vector<std::string> manifests(shards.size());
+    std::vector<bool> current(shards.size(), false);
+    for (size_t s = 0; s < shards.size(); ++s) {
+        wchar_t suffix[16];
+        swprintf(suffix, 16, L"_%03u", static_cast<unsigned int>(s));
+        fs::path shardBase = outputPath.parent_path() / (outputPath.stem().wstring() + suffix);
+        listPaths[s] = shardBase.wstring() + L".lst";
+        bankPaths[s] = shardBase.wstring() + L".fsb";
+        manifestPaths[s] = shardBase.wstring() + L".manifest";
+
+        std::string listContents;
+        for (size_t index : shards[s]) {
+            listContents += sources[index].path + "\n";
+        }
+
+        fs::ofstream(listPaths[s], std::ios::binary) << listContents;
+
+        manifests[s] = shardManifest(sources, shards[s], options);
+        fs::ifstream existingManifest(manifestPaths[s], std::ios::binary);
+        std::string existingContents((std::istreambuf_iterator<char>(existingManifest)), std::istreambuf_iterator<char>());
+        current[s] = fs::exists(bankPaths[s]) && existingContents == manifests[s];
+    }
+
+    std::atomic<size_t> nextShard = 0;
+    std::vector<int> exitCodes(shards.size(), -1);
+    std::vector<std::thread> workers;
+    for (size_t j = 0; j < std::min<size_t>(options.jobs, shards.size()); ++j) {
+        workers.emplace_back([&]() {
+            for (size_t s = nextShard++; s < shards.size() && !shouldCancel(); s = nextShard++) {
+                if (current[s]) {
+                    exitCodes[s] = 0;
+                    continue;
+                }
+
+                // Dropped first, so a build that dies part way never looks current
+                boost::system::error_code ec;
+                fs::remove(manifestPaths[s], ec);
+
+                std::vector<std::wstring> args = { L"create", listPaths[s].wstring(), L"--output", bankPaths[s].wstring(), L"--jobs", L"1", L"--no-progress" };
+                if (options.normalizeLufs < 0.0) {
+                    args.push_back(L"--normalize");
+                    args.push_back(std::to_wstring(options.normalizeLufs));
+                }
+                if (!options.tracePath.empty()) {
+                    args.push_back(L"--trace");
+                    args.push_back(fs::path(bankPaths[s]).replace_extension(L".trace.json").wstring());
+                }
+                if (!options.cacheDirectory.empty()) {
+                    args.push_back(L"--cache");
+                    args.push_back((options.cacheDirectory / bankPaths[s].stem()).wstring());
+                }
+                if (cancelDeadline != std::chrono::steady_clock::time_point::max()) {
+                    auto remaining = std::chrono::duration_cast<std::chrono::seconds>(cancelDeadline - std::chrono::steady_clock::now());
+                    args.push_back(L"--timeout");
+                    args.push_back(std::to_wstring(std::max<int64_t>(1, remaining.count() + 1)));
+                }
+                exitCodes[s] = bp::system(exePath, bp::args = args);
+                if (exitCodes[s] == 0 && !shouldCancel()) {
+                    fs::ofstream(manifestPaths[s], std::ios::binary) << manifests[s];
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (shouldCancel()) {
+        std::wcout << L"Sharded build cancelled, rerun the same command to finish the remaining shards" << std::endl;
+        return false;
+    }
+
+    fs::path indexPath = outputPath.parent_path() / (outputPath.stem().wstring() + L".shards.tsv");
+    fs::ofstream index(indexPath);
+    bool succeeded = true;
+    for (size_t s = 0; s < shards.size(); ++s) {
+        if (exitCodes[s] != 0) {
+            std::wcerr << L"Shard build failed (" << exitCodes[s] << L"): " << bankPaths[s].wstring() << std::endl;
+            succeeded = false;
+        }
+
+        std::string bankName = boost::nowide::narrow(bankPaths[s].filename().wstring());
+        for (size_t i = 0; i < shards[s].size(); ++i) {
+            index << sources[shards[s][i]].name << "\t" << bankName << "\t" << i << "\n";
+        }
+    }
+
+    std::wcout << L"Built " << shards.size() << L" shards, index written to " << indexPath.wstring() << std::endl;
+    return succeeded;
+}
+
+} // namespace
+
+bool createFSB(const fs::path& filePath, const ToolOptions& options) {
+    std::vector<std::wstring> fileNames = readFileList(filePath);
+    if (fileNames.empty()) {
+        return false;
+    }
+
+    fs::path outputPath = options.output;
+    if (outputPath.empty()) {
+        outputPath = fileNames.size() == 1 ? filePath.filename().replace_extension(L".fsb") : fs::path(L"Output.fsb");
+    }
+
+    bool sharded = options.maxBankSize || options.maxEntries;
+    bool dedup = options.dedup != DedupMode::Off;
+
+    BankBuilder builder;
+    builder.setJobs(options.jobs);
+    builder.setCacheDirectory(options.cacheDirectory);
+    builder.setProgress(options.progress);
+    builder.setTracePath(options.tracePath);
+
+    std::vector<std::string> paths;
+    if (sharded || dedup) {
+        std::vector<SourceEntry> sources = probeSources(fileNames, dedup, options.jobs);
+        if (dedup) {
+            sources = removeDuplicates(sources, outputPath, options.dedup);
+        }
+
+        if (sharded) {
+            return createShardedFSB(sources, outputPath, options);
+        }
+
+        for (const auto& source : sources) {
+            paths.push_back(source.path);
+        }
+    }
+    else {
+        for (const auto& fileName : fileNames) {
+            paths.push_back(boost::locale::conv::utf_to_utf<char>(fileName));
+        }
+    }
+
+    // Normalised sources go to FSBank as in-memory images, so nothing is written in between
+    std::vector<std::vector<char>> images;
+    if (options.normalizeLufs < 0.0) {
+        if (!normaliseSources(paths, options.normalizeLufs, options.jobs, images) || shouldCancel()) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (i < images.size() && !images[i].empty()) {
+            builder.addImage(paths[i], std::move(images[i]));
+        }
+        else {
+            builder.addFile(paths[i]);
+        }
+    }
+
+    FSBANK_RESULT result = builder.build(outputPath);
+    if (result == FSBANK_ERR_CANCELLED) {
+        return false;
+    }
+    ERRCHECK(result);
+    return true;
+}
+
+void createAll(const fs::path& root, const ToolOptions& options) {
+    std::vector<fs::path> manifests = findFiles(root, ".txt");
+    size_t built = 0;
+
+    for (const auto& manifest : manifests) {
+        if (shouldCancel()) {
+            break;
+        }
+
+        ToolOptions manifestOptions = options;
+        manifestOptions.output = fs::path(manifest).replace_extension(L".fsb");
+        std::wcout << manifest.wstring() << std::endl;
+        if (createFSB(manifest, manifestOptions)) {
+            ++built;
+        }
+    }
+
+    std::wcout << L"Built " << built << L" of " << manifests.size() << L" manifests" << std::endl;
+}
+
+} // namespace fsbtool
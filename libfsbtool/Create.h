@@ -0,0 +1,16 @@
+﻿#pragma once
+
+#include "Options.h"
+
+namespace fsbtool {
+
+// Builds a single source file or a .txt list of them into options.output, splitting into
+// shard banks when --max-bank-size or --max-entries is set. False when the list is empty, the
+// build was cancelled, a shard failed or the normalised sources would not fit in memory.
+bool createFSB(const fs::path& filePath, const ToolOptions& options);
+
+// Builds every .txt manifest under root into a bank beside it. FSBank is one per process, so banks
+// are built one after another and FSBank's own job threads provide the parallelism.
+void createAll(const fs::path& root, const ToolOptions& options);
+
+} // namespace fsbtool
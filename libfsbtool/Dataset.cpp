@@ -0,0 +1,221 @@
+﻿#include "Dataset.h"
+#include "Common.h"
+#include "Resampler.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Boost libraries
+#include <boost/filesystem/fstream.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/nowide/convert.hpp>
+
+namespace fsbtool {
+
+namespace {
+
+constexpr unsigned int kBlockFrames = 16384;
+
+struct Slot {
+    unsigned int startFrame = 0;
+    unsigned int inputFrames = 0;
+    int inputRate = 0;
+    int inputChannels = 0;
+    DatasetRecord record;
+};
+
+// Mono is spread to every channel, mono output averages every channel, and otherwise input
+// channel k is averaged into output channel k % to
+void mixChannels(const float* input, size_t frames, int from, int to, std::vector<float>& output) {
+    output.resize(frames * to);
+    if (from == to) {
+        std::copy(input, input + frames * from, output.begin());
+        return;
+    }
+
+    std::vector<int> counts(to, 0);
+    for (int k = 0; k < from; ++k) {
+        ++counts[k % to];
+    }
+    for (size_t f = 0; f < frames; ++f) {
+        const float* in = input + f * from;
+        float* out = output.data() + f * to;
+        if (from == 1) {
+            std::fill(out, out + to, in[0]);
+            continue;
+        }
+        std::fill(out, out + to, 0.0f);
+        for (int k = 0; k < from; ++k) {
+            out[k % to] += in[k];
+        }
+        for (int c = 0; c < to; ++c) {
+            out[c] /= counts[c];
+        }
+    }
+}
+
+} // namespace
+
+bool writeDataset(const BankReader& reader, const std::vector<int>& subsounds, const ClipTime& start, const ClipTime& end, int rate, int channels, const fs::path& datasetPath, unsigned int jobs) {
+    namespace bi = boost::interprocess;
+
+    // Every slot is placed from the header before anything is decoded
+    std::vector<Slot> slots(subsounds.size());
+    std::string names;
+    uint64_t blobSize = 0;
+    for (size_t s = 0; s < subsounds.size(); ++s) {
+        const SubsoundHeader& header = reader.getSubsound(subsounds[s]);
+        Slot& slot = slots[s];
+        slot.inputRate = header.rate;
+        slot.inputChannels = header.channels;
+        slot.startFrame = start.isSet() ? std::min(start.toFrames(header.rate), header.lengthPCM) : 0;
+        unsigned int endFrame = end.isSet() ? std::min(end.toFrames(header.rate), header.lengthPCM) : header.lengthPCM;
+        slot.inputFrames = endFrame > slot.startFrame ? endFrame - slot.startFrame : 0;
+
+        DatasetRecord& record = slot.record;
+        record.rate = rate ? rate : header.rate;
+        record.channels = channels ? channels : header.channels;
+        record.subsound = subsounds[s];
+        record.nameOffset = static_cast<uint32_t>(names.size());
+        record.nameLength = static_cast<uint32_t>(header.name.size());
+        names += header.name;
+        names.push_back('\0');
+
+        uint64_t outputFrames = slot.inputFrames;
+        if (header.rate && record.rate != header.rate) {
+            outputFrames = Resampler(1, header.rate, record.rate).outputFrames(slot.inputFrames);
+        }
+        blobSize = (blobSize + kDatasetAlignment - 1) / kDatasetAlignment * kDatasetAlignment;
+        record.offset = blobSize;
+        record.frames = outputFrames;
+        blobSize += outputFrames * record.channels * sizeof(float);
+    }
+
+    fs::path partPath = datasetPath.wstring() + L".part";
+    {
+        fs::ofstream create(partPath, std::ios::binary | std::ios::trunc);
+        if (!create) {
+            std::wcerr << L"Failed to create " << partPath.wstring() << std::endl;
+            return false;
+        }
+    }
+    fs::resize_file(partPath, blobSize);
+
+    std::unique_ptr<bi::file_mapping> mapping;
+    std::unique_ptr<bi::mapped_region> region;
+    char* blob = nullptr;
+    if (blobSize) {
+        mapping = std::make_unique<bi::file_mapping>(partPath.c_str(), bi::read_write);
+        region = std::make_unique<bi::mapped_region>(*mapping, bi::read_write);
+        blob = static_cast<char*>(region->get_address());
+    }
+
+    std::atomic<size_t> nextTask = 0;
+    std::atomic<int> written = 0;
+
+    auto work = [&]() {
+        SubsoundDecoder decoder;
+        std::vector<float> decoded;
+        std::vector<float> mixed;
+        std::vector<float> resampled;
+
+        for (size_t s = nextTask++; s < slots.size() && !shouldCancel(); s = nextTask++) {
+            Slot& slot = slots[s];
+            DatasetRecord& record = slot.record;
+            if (reader.openDecoder(record.subsound, decoder) != FMOD_OK || (slot.startFrame && decoder.seek(slot.startFrame) != FMOD_OK)) {
+                std::wcerr << L"Failed to decode " << boost::nowide::widen(reader.getSubsound(record.subsound).name) << std::endl;
+                record.frames = 0;
+                continue;
+            }
+
+            std::unique_ptr<Resampler> resampler;
+            if (record.rate != static_cast<uint32_t>(decoder.getRate())) {
+                resampler = std::make_unique<Resampler>(record.channels, decoder.getRate(), record.rate);
+            }
+
+            // Output past the reserved frames is dropped, a short decode leaves the rest silent
+            float* out = blob ? reinterpret_cast<float*>(blob + record.offset) : nullptr;
+            uint64_t frames = 0;
+            auto store = [&](const std::vector<float>& samples) {
+                uint64_t count = std::min<uint64_t>(samples.size() / record.channels, record.frames - frames);
+                memcpy(out + frames * record.channels, samples.data(), count * record.channels * sizeof(float));
+                frames += count;
+            };
+
+            int inputChannels = decoder.getChannels();
+            decoded.resize(static_cast<size_t>(kBlockFrames) * inputChannels);
+            unsigned int remaining = slot.inputFrames;
+            unsigned int read = 0;
+            while (remaining > 0 && decoder.readFloat(decoded.data(), std::min(kBlockFrames, remaining), &read) == FMOD_OK && read) {
+                mixChannels(decoded.data(), read, inputChannels, record.channels, mixed);
+                if (resampler) {
+                    resampled.clear();
+                    resampler->process(mixed.data(), read, resampled);
+                    store(resampled);
+                }
+                else {
+                    store(mixed);
+                }
+                remaining -= read;
+            }
+            if (resampler) {
+                resampled.clear();
+                resampler->flush(resampled);
+                store(resampled);
+            }
+
+            record.frames = frames;
+            ++written;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t j = 1; j < std::min<size_t>(jobs, slots.size()); ++j) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    if (region) {
+        region->flush();
+    }
+    region.reset();
+    mapping.reset();
+
+    // The index goes last, so a blob with an index beside it is always complete
+    fs::path indexPath = datasetPath.wstring() + L".index";
+    fs::path indexPartPath = indexPath.wstring() + L".part";
+    {
+        DatasetIndexHeader header;
+        header.count = static_cast<uint32_t>(slots.size());
+        header.namesOffset = sizeof(DatasetIndexHeader) + slots.size() * sizeof(DatasetRecord);
+
+        fs::ofstream index(indexPartPath, std::ios::binary | std::ios::trunc);
+        index.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const Slot& slot : slots) {
+            index.write(reinterpret_cast<const char*>(&slot.record), sizeof(slot.record));
+        }
+        index.write(names.data(), static_cast<std::streamsize>(names.size()));
+        if (!index) {
+            std::wcerr << L"Failed to write " << indexPartPath.wstring() << std::endl;
+            return false;
+        }
+    }
+
+    fs::rename(partPath, datasetPath);
+    fs::rename(indexPartPath, indexPath);
+    std::wcout << L"Wrote " << written << L" of " << slots.size() << L" subsounds, " << blobSize / (1024 * 1024) << L" MB, to "
+        << datasetPath.wstring() << (shouldCancel() ? L" (cancelled)" : L"") << std::endl;
+    return written == static_cast<int>(slots.size());
+}
+
+} // namespace fsbtool
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "BankReader.h"
+#include "Options.h"
+
+// Standard C++ headers
+#include <cstdint>
+#include <vector>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+// A dataset is one blob of interleaved float32 samples, each subsound starting on a
+// kDatasetAlignment byte boundary, plus an index beside it (<blob>.index) that can be used
+// straight from a mapping: a DatasetIndexHeader, count DatasetRecords, then the NUL terminated
+// UTF-8 names the records point into. Everything is little endian.
+constexpr uint32_t kDatasetAlignment = 64;
+constexpr uint32_t kDatasetVersion = 1;
+
+struct DatasetIndexHeader {
+    char magic[4] = { 'F', 'S', 'B', 'D' };
+    uint32_t version = kDatasetVersion;
+    uint32_t count = 0;
+    uint32_t alignment = kDatasetAlignment;
+    uint64_t namesOffset = 0;
+};
+
+struct DatasetRecord {
+    // Bytes into the blob
+    uint64_t offset = 0;
+    uint64_t frames = 0;
+    uint32_t rate = 0;
+    uint32_t channels = 0;
+    uint32_t subsound = 0;
+    // Bytes into the names
+    uint32_t nameOffset = 0;
+    uint32_t nameLength = 0;
+    uint32_t reserved = 0;
+};
+
+static_assert(sizeof(DatasetIndexHeader) == 24 && sizeof(DatasetRecord) == 40, "dataset index layout");
+
+// Decodes [start, end) of each subsound at its native rate, downmixes to channels and resamples
+// to rate (0 keeps the subsound's own), and writes the result into its slot of the blob on jobs
+// workers. Slots are sized from the bank header up front, so the blob is mapped once and every
+// worker writes in place.
+bool writeDataset(const BankReader& reader, const std::vector<int>& subsounds, const ClipTime& start, const ClipTime& end, int rate, int channels, const fs::path& datasetPath, unsigned int jobs);
+
+} // namespace fsbtool
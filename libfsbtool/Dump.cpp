@@ -0,0 +1,1088 @@
+﻿#include "Dump.h"
+#include "BankHeader.h"
+#include "Common.h"
+#include "Dataset.h"
+#include "Features.h"
+#include "FileCache.h"
+#include "Flac.h"
+#include "PcmHasher.h"
+#include "Peaks.h"
+#include "PoolAllocator.h"
+#include "Wav.h"
+#include "WorkStealingPool.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// Boost libraries
+#include <boost/filesystem/fstream.hpp>
+#include <boost/nowide/convert.hpp>
+#include <boost/locale.hpp>
+
+namespace fsbtool {
+
+namespace {
+
+// What one exporter's System, mixer and bank stream take from a fixed pool, with headroom
+constexpr uint64_t kExporterPoolBytes = 8 * 1024 * 1024;
+
+// Every exporter streams its own copy of the bank, so a fixed pool bounds how many can run
+unsigned int capJobsForPool(unsigned int jobs, uint64_t poolSize) {
+    if (!poolSize) {
+        return jobs;
+    }
+    unsigned int fit = static_cast<unsigned int>(std::max<uint64_t>(1, poolSize / kExporterPoolBytes));
+    if (jobs > fit) {
+        std::wcout << L"Running " << fit << L" of " << jobs << L" jobs to fit the " << poolSize / 1024 << L" KB FMOD pool" << std::endl;
+        return fit;
+    }
+    return jobs;
+}
+
+// Append-only record of finished exports, one "index\tsize\thash\tfile" line each, so --resume
+// can skip subsounds whose output is still on disk unchanged. A fresh run starts it over unless
+// append is set, as for a run exporting only some of the subsounds.
+class DumpJournal {
+public:
+    DumpJournal(const fs::path& journalPath, bool resume, bool append = false) {
+        if (resume) {
+            fs::ifstream existing(journalPath);
+            std::string line;
+            while (std::getline(existing, line)) {
+                std::istringstream fields(line);
+                int index;
+                Entry entry;
+                if (fields >> index >> entry.size >> std::hex >> entry.hash >> std::dec && fields.get() == '\t' && std::getline(fields, entry.file)) {
+                    entries[index] = entry;
+                }
+            }
+        }
+
+        journal.open(journalPath, resume || append ? std::ios::app : std::ios::trunc);
+    }
+
+    bool isComplete(int index, const fs::path& outputPath) const {
+        auto entry = entries.find(index);
+        if (entry == entries.end() || entry->second.file != boost::nowide::narrow(outputPath.wstring())) {
+            return false;
+        }
+
+        uint64_t size = 0;
+        uint64_t hash = 0;
+        return hashFile(outputPath, size, hash) && size == entry->second.size && hash == entry->second.hash;
+    }
+
+    void record(int index, const fs::path& outputPath) {
+        uint64_t size = 0;
+        uint64_t hash = 0;
+        if (hashFile(outputPath, size, hash)) {
+            std::lock_guard<std::mutex> guard(lock);
+            journal << index << "\t" << size << "\t" << std::hex << hash << std::dec << "\t" << boost::nowide::narrow(outputPath.wstring()) << std::endl;
+        }
+    }
+
+private:
+    struct Entry {
+        uint64_t size = 0;
+        uint64_t hash = 0;
+        std::string file;
+    };
+
+    std::map<int, Entry> entries;
+    std::mutex lock;
+    fs::ofstream journal;
+};
+
+class CostReport {
+public:
+    void add(const std::string& bank, int index, const SubsoundHeader& subsound, double predicted, double actual) {
+        std::lock_guard<std::mutex> guard(lock);
+        rows.push_back({ bank, index, subsound, predicted, actual });
+    }
+
+    void write(const fs::path& csvPath) const {
+        fs::ofstream csv(csvPath);
+        csv << "bank,index,samples,channels,bytes,predicted,actual\n";
+
+        double predictedTotal = 0.0;
+        double actualTotal = 0.0;
+        for (const auto& row : rows) {
+            csv << row.bank << "," << row.index << "," << row.subsound.lengthPCM << "," << row.subsound.channels << ","
+                << row.subsound.compressedSize << "," << row.predicted << "," << row.actual << "\n";
+            predictedTotal += row.predicted;
+            actualTotal += row.actual;
+        }
+
+        std::wcout << L"Cost model: predicted " << predictedTotal << L"s, actual " << actualTotal << L"s over "
+            << rows.size() << L" subsounds" << std::endl;
+    }
+
+private:
+    struct Row {
+        std::string bank;
+        int index;
+        SubsoundHeader subsound;
+        double predicted;
+        double actual;
+    };
+
+    std::mutex lock;
+    std::vector<Row> rows;
+};
+
+// Silence trimmed from each export, as a CSV of frame offsets to feed back into the sources
+class TrimReport {
+public:
+    void add(const std::string& bank, int index, const std::string& name, int rate, const SilenceTrim& trim) {
+        std::lock_guard<std::mutex> guard(lock);
+        rows.push_back({ bank, index, name, rate, trim });
+    }
+
+    void write(const fs::path& csvPath) const {
+        double leading = 0.0;
+        double trailing = 0.0;
+        size_t trimmed = 0;
+        for (const auto& row : rows) {
+            leading += row.rate ? static_cast<double>(row.trim.leading) / row.rate : 0.0;
+            trailing += row.rate ? static_cast<double>(row.trim.trailing) / row.rate : 0.0;
+            trimmed += row.trim.leading || row.trim.trailing;
+        }
+        std::wcout << L"Trimmed " << leading << L"s leading and " << trailing << L"s trailing silence from " << trimmed
+            << L" of " << rows.size() << L" subsounds" << std::endl;
+
+        if (csvPath.empty()) {
+            return;
+        }
+        fs::ofstream csv(csvPath);
+        csv << "bank,index,name,rate,frames,leading,trailing,kept\n";
+        for (const auto& row : rows) {
+            csv << row.bank << "," << row.index << "," << row.name << "," << row.rate << "," << row.trim.frames << ","
+                << row.trim.leading << "," << row.trim.trailing << "," << row.trim.frames - row.trim.leading - row.trim.trailing << "\n";
+        }
+    }
+
+private:
+    struct Row {
+        std::string bank;
+        int index;
+        std::string name;
+        int rate;
+        SilenceTrim trim;
+    };
+
+    std::mutex lock;
+    std::vector<Row> rows;
+};
+
+// Writes PCM blocks to a WAV while feeding the peak and feature sidecars and cutting silence,
+// so whichever path produced the blocks the sidecars and trim offsets describe the samples in
+// the file. Leading silence is never written, trailing silence is written and cut back once the
+// last signal is known, so a long tail costs no memory.
+class AnalysedWavWriter {
+public:
+    AnalysedWavWriter(WavFile& output, const WavFormat& format, FMOD_SOUND_FORMAT sampleFormat, const fs::path& outputPath, bool writePeaks, const FeatureSettings& features, SilenceTrim* trim)
+        : wav(output), format(format), sampleFormat(sampleFormat), outputPath(outputPath), writePeaks(writePeaks), trim(trim) {
+        if (writePeaks) {
+            peaks.begin(format.channels, format.rate);
+        }
+        writeFeatures = features.isSet() && featureWriter.open(fs::path(outputPath).replace_extension(L".features"), features, format.channels, format.rate);
+    }
+
+    void write(const void* data, unsigned int frames) {
+        if (writePeaks || writeFeatures || trim) {
+            samples.resize(static_cast<size_t>(frames) * format.channels);
+            convertToFloat(data, sampleFormat, samples.size(), samples.data());
+        }
+
+        unsigned int skip = 0;
+        if (trim) {
+            unsigned int first = 0;
+            unsigned int last = 0;
+            if (findSignal(samples.data(), frames, format.channels, trim->threshold, first, last)) {
+                if (!signal) {
+                    signal = true;
+                    signalStart = written + first;
+                    skip = first;
+                }
+                signalEnd = written + last + 1;
+            }
+            else if (!signal) {
+                skip = frames;
+            }
+        }
+
+        if (skip < frames) {
+            wav.write(static_cast<const char*>(data) + static_cast<size_t>(skip) * format.frameBytes(), frames - skip);
+            if (writePeaks) {
+                peaks.add(samples.data() + static_cast<size_t>(skip) * format.channels, frames - skip);
+            }
+            if (writeFeatures) {
+                featureWriter.add(samples.data() + static_cast<size_t>(skip) * format.channels, frames - skip);
+            }
+        }
+        written += frames;
+    }
+
+    // Cuts the trailing silence and fills in trim, before the WAV is closed
+    void finish() {
+        if (trim) {
+            wav.truncate(signalEnd - signalStart);
+            trim->frames = written;
+            trim->leading = signal ? signalStart : written;
+            trim->trailing = signal ? written - signalEnd : 0;
+        }
+    }
+
+    // Drops the partial sidecars of an export that failed
+    void discard() {
+        if (writeFeatures) {
+            featureWriter.discard();
+        }
+    }
+
+    // Saves the sidecars once the WAV is in place
+    void save() {
+        if (writePeaks) {
+            peaks.finish();
+            peaks.save(fs::path(outputPath).replace_extension(L".peaks"));
+        }
+        if (writeFeatures) {
+            featureWriter.close();
+        }
+    }
+
+private:
+    WavFile& wav;
+    WavFormat format;
+    FMOD_SOUND_FORMAT sampleFormat;
+    fs::path outputPath;
+    bool writePeaks;
+    bool writeFeatures = false;
+    SilenceTrim* trim;
+    PeakPyramid peaks;
+    FeatureWriter featureWriter;
+    std::vector<float> samples;
+    uint64_t written = 0;
+    uint64_t signalStart = 0;
+    uint64_t signalEnd = 0;
+    bool signal = false;
+};
+
+} // namespace
+
+void initFMOD(uint64_t poolSize) {
+    FMOD_RESULT result;
+
+    if (poolSize) {
+        // FMOD wants the pool 512 byte aligned and a multiple of 512 bytes long
+        static std::vector<char> poolMemory;
+        size_t poolLength = static_cast<size_t>(poolSize) & ~size_t(511);
+        poolMemory.resize(poolLength + 512);
+
+        void* aligned = poolMemory.data();
+        size_t space = poolMemory.size();
+        std::align(512, poolLength, aligned, space);
+
+        result = FMOD::Memory_Initialize(aligned, static_cast<int>(poolLength), nullptr, nullptr, nullptr);
+    }
+    else {
+        result = FMOD::Memory_Initialize(nullptr, 0, fmodAlloc, fmodRealloc, fmodFree);
+    }
+    ERRCHECK(result);
+
+    //only on fmodl.dll
+#ifdef _DEBUG
+    result = FMOD::Debug_Initialize(FMOD_DEBUG_LEVEL_LOG, FMOD_DEBUG_MODE_FILE, nullptr, "fmodlog.txt");
+    ERRCHECK(result);
+#endif
+}
+
+void printFMODMemory(const std::string& label, bool pooled) {
+    int currentAlloced = 0;
+    int maxAlloced = 0;
+    FMOD::Memory_GetStats(&currentAlloced, &maxAlloced, false);
+
+    // FMOD's own maximum never resets, so with a fixed pool the peak is for the whole run
+    int64_t peak = pooled ? maxAlloced : fmodPool.peakBytes();
+    std::wcout << boost::nowide::widen(label) << L": FMOD memory current " << currentAlloced / 1024 << L" KB, peak "
+        << peak / 1024 << L" KB" << (pooled ? L" (run)" : L"") << std::endl;
+}
+
+std::vector<std::string> readSubsoundNames(const std::string& utf8FilePath) {
+    BankHeader header;
+    if (readBankHeader(boost::nowide::widen(utf8FilePath), header)) {
+        std::vector<std::string> names;
+        for (const auto& subsound : header.subsounds) {
+            names.push_back(subsound.name);
+        }
+        if (std::none_of(names.begin(), names.end(), [](const std::string& name) { return name.empty(); })) {
+            return names;
+        }
+    }
+
+    FMOD::System* system = nullptr;
+    FMOD::Sound* sound = nullptr;
+    FMOD_RESULT result;
+    unsigned int version = 0;
+
+    result = FMOD::System_Create(&system);
+    ERRCHECK(result);
+
+    result = readAheadFiles.install(system);
+    ERRCHECK(result);
+
+    result = system->getVersion(&version);
+    ERRCHECK(result);
+
+    if (version < FMOD_VERSION) {
+        wprintf(L"Error!  You are using an old version of FMOD %08x.  This program requires %08x\n", version, FMOD_VERSION);
+        exit(-1);
+    }
+
+    result = system->init(32, FMOD_INIT_NORMAL, nullptr);
+    ERRCHECK(result);
+
+
+    // Opened only, so nothing is decoded just to read the names
+    result = system->createSound(utf8FilePath.c_str(), FMOD_CREATESTREAM | FMOD_OPENONLY, nullptr, &sound);
+    ERRCHECK(result);
+
+
+    int numSubSounds = 0;
+    result = sound->getNumSubSounds(&numSubSounds);
+    ERRCHECK(result);
+
+    std::vector<std::string> SoundNames;
+    for (int i = 0; i < numSubSounds; ++i) {
+        FMOD::Sound* subsound = nullptr;
+        result = sound->getSubSound(i, &subsound);
+        ERRCHECK(result);
+
+        std::vector<char> name(256);
+        result = subsound->getName(name.data(), static_cast<int>(name.size()));
+        ERRCHECK(result);
+        SoundNames.emplace_back(name.data());
+    }
+
+    result = sound->release();
+    ERRCHECK(result);
+    readAheadFiles.addUsage(system);
+    result = system->release();
+    ERRCHECK(result);
+
+    return SoundNames;
+}
+
+bool SubsoundExporter::openBank(const std::string& utf8FilePath) {
+    FMOD_RESULT result;
+    if (!system) {
+        result = FMOD::System_Create(&system);
+        if (result == FMOD_OK) {
+            result = readAheadFiles.install(system);
+        }
+        if (result == FMOD_OK) {
+            result = output.init(system, 32, FMOD_INIT_STREAM_FROM_UPDATE);
+        }
+        if (result != FMOD_OK) {
+            std::wcerr << L"Failed to create the mix System: " << FMOD_WErrorString(result) << std::endl;
+            close();
+            return false;
+        }
+    }
+
+    if (bank && bankPath == utf8FilePath) {
+        return true;
+    }
+    if (bank) {
+        bank->release();
+        bank = nullptr;
+    }
+
+    // Streamed, so each exporter holds the stream buffers rather than the decoded bank
+    result = system->createSound(utf8FilePath.c_str(), FMOD_CREATESTREAM, nullptr, &bank);
+    if (result != FMOD_OK) {
+        std::wcerr << L"Failed to open " << boost::nowide::widen(utf8FilePath) << L": " << FMOD_WErrorString(result) << std::endl;
+        bank = nullptr;
+        return false;
+    }
+    bankPath = utf8FilePath;
+    return true;
+}
+
+void SubsoundExporter::close() {
+    if (bank) {
+        bank->release();
+        bank = nullptr;
+    }
+    if (system) {
+        readAheadFiles.addUsage(system);
+        system->release();
+        system = nullptr;
+    }
+    bankPath.clear();
+}
+
+bool SubsoundExporter::render(const std::string& utf8FilePath, int index, const MixSink& sink) {
+    if (!openBank(utf8FilePath)) {
+        return false;
+    }
+
+    FMOD::Sound* subsound = nullptr;
+    FMOD::Channel* channel = nullptr;
+    FMOD_RESULT result = bank->getSubSound(index, &subsound);
+    if (result == FMOD_OK) {
+        result = system->playSound(subsound, nullptr, false, &channel);
+    }
+
+    // The sink only sees blocks mixed while this subsound plays
+    output.setSink(sink);
+    bool playing = result == FMOD_OK;
+    while (playing) {
+        result = system->update();
+        if (result == FMOD_OK) {
+            result = channel->isPlaying(&playing);
+        }
+        if (result != FMOD_OK) {
+            playing = false;
+        }
+    }
+    output.setSink(nullptr);
+
+    // The subsound is the bank stream switched to index, and is released with the bank
+    if (result != FMOD_OK) {
+        std::wcerr << L"Failed to play subsound " << index << L": " << FMOD_WErrorString(result) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SubsoundExporter::exportFile(const std::string& utf8FilePath, int index, const fs::path& outputPath, bool writePeaks, const FeatureSettings& features, SilenceTrim* trim) {
+    if (!openBank(utf8FilePath)) {
+        return false;
+    }
+
+    fs::path partPath = outputPath.wstring() + L".part";
+    bool written = false;
+    if (flacLevel >= 0) {
+        fs::ofstream file(partPath, std::ios::binary | std::ios::trunc);
+        FlacEncoder flac;
+        if (!file || !flac.open(file, getFormat(), flacLevel, flacThreads)) {
+            std::wcerr << L"Failed to create " << partPath.wstring() << std::endl;
+            return false;
+        }
+
+        bool rendered = render(utf8FilePath, index, [&](const void* data, unsigned int frames) {
+            flac.write(data, frames);
+        });
+        written = flac.close() && rendered;
+    }
+    else {
+        WavFile wav;
+        if (!wav.open(partPath, getFormat())) {
+            std::wcerr << L"Failed to create " << partPath.wstring() << std::endl;
+            return false;
+        }
+
+        // The mixer always renders 16 bit
+        AnalysedWavWriter writer(wav, getFormat(), FMOD_SOUND_FORMAT_PCM16, outputPath, writePeaks, features, trim);
+        bool rendered = render(utf8FilePath, index, [&](const void* data, unsigned int frames) {
+            writer.write(data, frames);
+        });
+        writer.finish();
+        written = wav.close() && rendered;
+        if (written) {
+            writer.save();
+        }
+        else {
+            writer.discard();
+        }
+    }
+
+    if (!written) {
+        fs::remove(partPath);
+        return false;
+    }
+    fs::rename(partPath, outputPath);
+    return true;
+}
+
+bool SubsoundExporter::renderFile(const std::string& utf8FilePath, int index, std::vector<char>& file) {
+    if (!openBank(utf8FilePath)) {
+        return false;
+    }
+
+    if (flacLevel >= 0) {
+        std::ostringstream stream;
+        FlacEncoder flac;
+        if (!flac.open(stream, getFormat(), flacLevel, flacThreads)) {
+            return false;
+        }
+
+        bool rendered = render(utf8FilePath, index, [&](const void* data, unsigned int frames) {
+            flac.write(data, frames);
+        });
+        if (!flac.close() || !rendered) {
+            return false;
+        }
+        std::string bytes = stream.str();
+        file.assign(bytes.begin(), bytes.end());
+        return true;
+    }
+
+    // The header size depends only on the format, so it is reserved up front and filled in last
+    std::ostringstream header;
+    writeWavHeader(header, getFormat(), 0);
+    size_t headerSize = header.str().size();
+    file.assign(headerSize, 0);
+
+    bool rendered = render(utf8FilePath, index, [&](const void* data, unsigned int frames) {
+        const char* bytes = static_cast<const char*>(data);
+        file.insert(file.end(), bytes, bytes + static_cast<size_t>(frames) * getFormat().frameBytes());
+    });
+    if (!rendered || file.size() - headerSize > UINT32_MAX) {
+        file.clear();
+        return false;
+    }
+
+    header.str("");
+    writeWavHeader(header, getFormat(), static_cast<uint32_t>(file.size() - headerSize));
+    std::string filled = header.str();
+    std::copy(filled.begin(), filled.end(), file.begin());
+    return true;
+}
+
+void exportSubsound(const std::string& utf8FilePath, int index, const fs::path& outputPath, bool reportMemory, bool pooled) {
+    if (reportMemory) {
+        fmodPool.resetPeak();
+    }
+
+    SubsoundExporter exporter;
+    exporter.exportFile(utf8FilePath, index, outputPath);
+
+    if (reportMemory) {
+        printFMODMemory(boost::nowide::narrow(outputPath.filename().wstring()), pooled);
+    }
+}
+
+bool exportClip(const BankReader& reader, SubsoundDecoder& decoder, int index, const ClipTime& start, const ClipTime& end, const fs::path& outputPath, bool writePeaks, const FeatureSettings& features, SilenceTrim* trim) {
+    FMOD_RESULT result = reader.openDecoder(index, decoder);
+    if (result != FMOD_OK) {
+        std::wcerr << L"Failed to open subsound " << index << L": " << FMOD_WErrorString(result) << std::endl;
+        return false;
+    }
+
+    unsigned int startFrame = start.isSet() ? start.toFrames(decoder.getRate()) : 0;
+    unsigned int endFrame = end.isSet() ? std::min(end.toFrames(decoder.getRate()), decoder.getLength()) : decoder.getLength();
+    if (startFrame >= endFrame) {
+        std::wcerr << L"Clip is empty for " << outputPath.filename().wstring() << L" (" << decoder.getLength() << L" frames)" << std::endl;
+        return false;
+    }
+
+    result = decoder.seek(startFrame);
+    if (result != FMOD_OK) {
+        std::wcerr << L"Failed to seek " << outputPath.filename().wstring() << L": " << FMOD_WErrorString(result) << std::endl;
+        return false;
+    }
+
+    WavFormat format;
+    format.rate = decoder.getRate();
+    format.channels = decoder.getChannels();
+    format.bits = decoder.getBits();
+    format.isFloat = decoder.getFormat() == FMOD_SOUND_FORMAT_PCMFLOAT;
+
+    fs::path partPath = outputPath.wstring() + L".part";
+    WavFile wav;
+    if (!wav.open(partPath, format)) {
+        std::wcerr << L"Failed to create " << partPath.wstring() << std::endl;
+        return false;
+    }
+
+    AnalysedWavWriter writer(wav, format, decoder.getFormat(), outputPath, writePeaks, features, trim);
+
+    const unsigned int blockFrames = 16384;
+    std::vector<char> buffer(static_cast<size_t>(blockFrames) * format.frameBytes());
+    unsigned int remaining = endFrame - startFrame;
+    unsigned int read = 0;
+    result = FMOD_OK;
+    while (remaining > 0) {
+        result = decoder.read(buffer.data(), std::min(blockFrames, remaining), &read);
+        if (result != FMOD_OK || read == 0) {
+            break;
+        }
+        writer.write(buffer.data(), read);
+        remaining -= read;
+    }
+    writer.finish();
+
+    // Only a clip read to its end is renamed into place; anything else leaves no file behind
+    bool complete = remaining == 0 || result == FMOD_ERR_FILE_EOF;
+    if (!complete) {
+        std::wcerr << L"Failed to decode " << outputPath.filename().wstring() << L": " << FMOD_WErrorString(result) << std::endl;
+    }
+    if (!wav.close() || !complete) {
+        boost::system::error_code ec;
+        fs::remove(partPath, ec);
+        writer.discard();
+        return false;
+    }
+    fs::rename(partPath, outputPath);
+    writer.save();
+    return true;
+}
+
+bool writePreviewReel(const BankReader& reader, const std::vector<int>& subsounds, const ClipTime& length, const fs::path& reelPath, unsigned int jobs) {
+    SubsoundDecoder first;
+    if (subsounds.empty() || reader.openDecoder(subsounds[0], first) != FMOD_OK) {
+        return false;
+    }
+
+    WavFormat format;
+    format.rate = first.getRate();
+    format.channels = first.getChannels();
+    format.bits = 16;
+    first.close();
+
+    fs::path partPath = reelPath.wstring() + L".part";
+    WavFile reel;
+    if (!reel.open(partPath, format)) {
+        std::wcerr << L"Failed to create " << partPath.wstring() << std::endl;
+        return false;
+    }
+
+    // Previews finish out of order; each waits here until everything before it is in the reel
+    std::mutex reelLock;
+    std::map<size_t, std::vector<int16_t>> finished;
+    size_t nextToWrite = 0;
+    std::atomic<size_t> nextTask = 0;
+    std::atomic<int> skipped = 0;
+
+    auto work = [&]() {
+        SubsoundDecoder decoder;
+        std::vector<float> decoded;
+
+        for (size_t t = nextTask++; t < subsounds.size() && !shouldCancel(); t = nextTask++) {
+            std::vector<int16_t> preview;
+            if (reader.openDecoder(subsounds[t], decoder) == FMOD_OK && decoder.getRate() == format.rate) {
+                int channels = decoder.getChannels();
+                unsigned int frames = std::min(length.toFrames(decoder.getRate()), decoder.getLength());
+                unsigned int total = 0;
+                unsigned int read = 0;
+                decoded.resize(static_cast<size_t>(frames) * channels);
+                while (total < frames && decoder.readFloat(decoded.data() + static_cast<size_t>(total) * channels, frames - total, &read) == FMOD_OK) {
+                    total += read;
+                }
+
+                // Mono is spread to every reel channel, otherwise extra channels are dropped
+                preview.resize(static_cast<size_t>(total) * format.channels);
+                for (size_t f = 0; f < total; ++f) {
+                    for (int c = 0; c < format.channels; ++c) {
+                        float sample = channels == 1 ? decoded[f] : c < channels ? decoded[f * channels + c] : 0.0f;
+                        preview[f * format.channels + c] = static_cast<int16_t>(std::clamp(sample, -1.0f, 1.0f) * 32767.0f);
+                    }
+                }
+            }
+            else {
+                ++skipped;
+            }
+
+            std::lock_guard<std::mutex> guard(reelLock);
+            finished[t] = std::move(preview);
+            while (!finished.empty() && finished.begin()->first == nextToWrite) {
+                const auto& ready = finished.begin()->second;
+                if (!ready.empty()) {
+                    reel.addCue(reel.getFrames(), reader.getSubsound(subsounds[nextToWrite]).name);
+                    reel.write(ready.data(), static_cast<unsigned int>(ready.size() / format.channels));
+                }
+                finished.erase(finished.begin());
+                ++nextToWrite;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t j = 1; j < std::min<size_t>(jobs, subsounds.size()); ++j) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    uint64_t frames = reel.getFrames();
+    if (!reel.close() || shouldCancel()) {
+        boost::system::error_code ec;
+        fs::remove(partPath, ec);
+        return false;
+    }
+    fs::rename(partPath, reelPath);
+
+    std::wcout << L"Preview reel " << reelPath.wstring() << L": " << subsounds.size() - skipped << L" subsounds, "
+        << frames / format.rate << L"s";
+    if (skipped) {
+        std::wcout << L", " << skipped << L" skipped (not " << format.rate << L" Hz or failed to open)";
+    }
+    std::wcout << std::endl;
+    return true;
+}
+
+void dumpFSB(const fs::path& filePath, const ToolOptions& options) {
+    bool pooled = options.fmodPoolSize != 0;
+
+    initFMOD(options.fmodPoolSize);
+    readAheadFiles.setBlockSize(options.readBlockSize);
+
+    std::string utf8FilePath = boost::locale::conv::utf_to_utf<char>(filePath.wstring());
+
+    // A preview is a clip of the head of every subsound
+    ClipTime clipStart = options.preview.isSet() ? ClipTime() : options.clipStart;
+    ClipTime clipEnd = options.preview.isSet() ? options.preview : options.clipEnd;
+
+    // Clips, datasets and single subsounds go through a BankReader, whose decoders stream and
+    // seek, and which reads the names without loading the bank
+    bool clipping = clipStart.isSet() || clipEnd.isSet();
+    bool trimming = options.trimDb < 0.0;
+    BankReader reader;
+    std::vector<std::string> SoundNames;
+    if (clipping || !options.subsound.empty() || !options.datasetPath.empty()) {
+        FMOD_RESULT result = reader.open(filePath);
+        if (result != FMOD_OK) {
+            std::wcerr << L"Failed to open " << filePath.wstring() << L": " << FMOD_WErrorString(result) << std::endl;
+            return;
+        }
+        for (int i = 0; i < reader.getNumSubsounds(); ++i) {
+            SoundNames.push_back(reader.getSubsound(i).name);
+        }
+    }
+    else {
+        SoundNames = readSubsoundNames(utf8FilePath);
+    }
+    int numSubSounds = static_cast<int>(SoundNames.size());
+
+    BankHeader header;
+    bool haveHeader = readBankHeader(filePath, header) && header.subsounds.size() == SoundNames.size();
+    CostModel costModel;
+    CostReport costReport;
+    TrimReport trimReport;
+    std::string bankName = boost::nowide::narrow(filePath.filename().wstring());
+
+    // Longest predicted export first, so no worker is left decoding a long track at the end
+    std::vector<int> order(numSubSounds);
+    for (int i = 0; i < numSubSounds; ++i) {
+        order[i] = i;
+    }
+    if (haveHeader) {
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return costModel.predict(header.subsounds[a]) > costModel.predict(header.subsounds[b]);
+        });
+    }
+    if (!options.subsound.empty()) {
+        int index = reader.findSubsound(options.subsound);
+        if (index < 0) {
+            std::wcerr << L"No such subsound: " << boost::nowide::widen(options.subsound) << std::endl;
+            return;
+        }
+        order.assign(1, index);
+        numSubSounds = 1;
+    }
+
+    if (!options.datasetPath.empty()) {
+        std::vector<int> datasetOrder = order;
+        std::sort(datasetOrder.begin(), datasetOrder.end());
+        writeDataset(reader, datasetOrder, clipStart, clipEnd, options.datasetRate, options.datasetChannels, options.datasetPath, options.jobs);
+        return;
+    }
+
+    if (!options.previewReelPath.empty()) {
+        std::vector<int> reelOrder = order;
+        std::sort(reelOrder.begin(), reelOrder.end());
+        writePreviewReel(reader, reelOrder, clipEnd, options.previewReelPath, options.jobs);
+        return;
+    }
+
+    ArchiveWriter archive;
+    if (!options.archivePath.empty() && !archive.open(options.archivePath)) {
+        std::wcerr << L"Failed to create " << options.archivePath.wstring() << std::endl;
+        return;
+    }
+
+    // Only full exports to disk are journaled. Clips and archives never touch the journal, and a
+    // single subsound adds to it, so neither wipes the state an interrupted dump resumes from.
+    std::unique_ptr<DumpJournal> journal;
+    if (!clipping && !archive.isOpen()) {
+        journal = std::make_unique<DumpJournal>(filePath.stem().wstring() + L".journal", options.resume, !options.subsound.empty());
+    }
+
+    // Export each sub sound as a WAV
+    bool reportMemory = options.jobs == 1;
+    std::atomic<size_t> nextTask = 0;
+    std::atomic<int> exported = 0;
+    std::atomic<int> resumed = 0;
+    std::atomic<int> failed = 0;
+
+    float trimThreshold = static_cast<float>(std::pow(10.0, options.trimDb / 20.0));
+
+    // Spare threads go to FLAC frame encoding when there are fewer subsounds than jobs
+    unsigned int jobs = clipping ? options.jobs : capJobsForPool(options.jobs, options.fmodPoolSize);
+    unsigned int workers = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(jobs, order.size())));
+    auto work = [&]() {
+        SubsoundDecoder decoder;
+        SubsoundExporter exporter;
+        exporter.setFlac(options.flacLevel, options.jobs / workers);
+
+        for (size_t t = nextTask++; t < order.size() && !shouldCancel(); t = nextTask++) {
+            int i = order[t];
+            fs::path outputPath = boost::nowide::widen(SoundNames[i] + exporter.getExtension());
+            SilenceTrim trim;
+            trim.threshold = trimThreshold;
+
+            // A clip is not the subsound's full export, so it stays out of the journal
+            if (clipping) {
+                if (exportClip(reader, decoder, i, clipStart, clipEnd, outputPath, options.peaks, options.features, trimming ? &trim : nullptr)) {
+                    ++exported;
+                    if (trimming) {
+                        trimReport.add(bankName, i, SoundNames[i], reader.getSubsound(i).rate, trim);
+                    }
+                }
+                continue;
+            }
+
+            if (journal && options.resume && journal->isComplete(i, outputPath)) {
+                ++exported;
+                ++resumed;
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            bool succeeded = false;
+            if (!journal) {
+                std::vector<char> wav;
+                succeeded = exporter.renderFile(utf8FilePath, i, wav);
+                if (succeeded) {
+                    archive.add(boost::nowide::narrow(outputPath.wstring()), std::move(wav));
+                }
+            }
+            else {
+                if (reportMemory) {
+                    fmodPool.resetPeak();
+                }
+                succeeded = exporter.exportFile(utf8FilePath, i, outputPath, options.peaks, options.features, trimming ? &trim : nullptr);
+                if (succeeded && trimming) {
+                    trimReport.add(bankName, i, SoundNames[i], exporter.getFormat().rate, trim);
+                }
+                if (reportMemory) {
+                    printFMODMemory(boost::nowide::narrow(outputPath.filename().wstring()), pooled);
+                }
+            }
+
+            // A failed export is neither counted nor journaled, so an older file left under its
+            // name is never taken for this run's output
+            if (!succeeded) {
+                ++failed;
+                continue;
+            }
+            if (haveHeader) {
+                double actual = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                costReport.add(bankName, i, header.subsounds[i], costModel.predict(header.subsounds[i]), actual);
+            }
+
+            if (journal) {
+                journal->record(i, outputPath);
+            }
+            ++exported;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int j = 1; j < workers; ++j) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (archive.isOpen() && archive.close()) {
+        std::wcout << L"Archived " << archive.getEntries() << L" subsounds to " << options.archivePath.wstring() << std::endl;
+    }
+    if (resumed) {
+        std::wcout << L"Resumed, skipped " << resumed << L" subsounds already in the journal" << std::endl;
+    }
+    if (failed) {
+        std::wcout << failed << L" subsounds failed to export" << std::endl;
+    }
+    if (shouldCancel() && exported < numSubSounds) {
+        std::wcout << L"Cancelled after " << exported << L" of " << numSubSounds << L" subsounds" << std::endl;
+    }
+    if (!options.costReportPath.empty()) {
+        costReport.write(options.costReportPath);
+    }
+    if (trimming) {
+        trimReport.write(options.trimReportPath);
+    }
+
+    if (reader.isOpen()) {
+        readAheadFiles.addUsage(reader.getSystem());
+    }
+    readAheadFiles.report();
+    if (pooled) {
+        printFMODMemory("Run", pooled);
+    }
+    else {
+        fmodPool.report();
+    }
+}
+
+void dumpAll(const fs::path& root, const ToolOptions& options) {
+    bool pooled = options.fmodPoolSize != 0;
+
+    initFMOD(options.fmodPoolSize);
+    readAheadFiles.setBlockSize(options.readBlockSize);
+
+    std::vector<fs::path> banks = findFiles(root, ".fsb");
+    std::vector<std::unique_ptr<DumpJournal>> journals;
+    std::atomic<size_t> exported = 0;
+    std::atomic<size_t> resumed = 0;
+    std::atomic<size_t> failed = 0;
+    CostModel costModel;
+    CostReport costReport;
+    WorkStealingPool pool(capJobsForPool(options.jobs, options.fmodPoolSize));
+
+    bool trimming = options.trimDb < 0.0;
+    float trimThreshold = static_cast<float>(std::pow(10.0, options.trimDb / 20.0));
+    TrimReport trimReport;
+
+    // One mix System per worker, kept across tasks so consecutive subsounds of a bank share it
+    std::vector<std::unique_ptr<SubsoundExporter>> exporters;
+    for (size_t i = 0; i < pool.size(); ++i) {
+        exporters.push_back(std::make_unique<SubsoundExporter>());
+        exporters.back()->setFlac(options.flacLevel, 1);
+    }
+
+    // With --archive every WAV goes into one archive under the path it would have had on disk
+    ArchiveWriter archive;
+    if (!options.archivePath.empty() && !archive.open(options.archivePath)) {
+        std::wcerr << L"Failed to create " << options.archivePath.wstring() << std::endl;
+        return;
+    }
+
+    for (const auto& bank : banks) {
+        fs::path entryDir = fs::relative(bank.parent_path(), root) / bank.stem();
+        fs::path outputDir = fs::current_path() / entryDir;
+        DumpJournal* journal = nullptr;
+        if (!archive.isOpen()) {
+            fs::create_directories(outputDir);
+            journals.push_back(std::make_unique<DumpJournal>(outputDir / (bank.stem().wstring() + L".journal"), options.resume));
+            journal = journals.back().get();
+        }
+        pool.submit([&, bank, entryDir, outputDir, journal]() {
+            if (shouldCancel()) {
+                return;
+            }
+
+            std::string utf8FilePath = boost::nowide::narrow(bank.wstring());
+            std::vector<std::string> names = readSubsoundNames(utf8FilePath);
+
+            BankHeader header;
+            bool haveHeader = readBankHeader(bank, header) && header.subsounds.size() == names.size();
+            std::string bankName = boost::nowide::narrow(fs::relative(bank, root).wstring());
+
+            // Queued cheapest first: this worker and any thief both take from the back, so each
+            // idle worker starts the longest subsound left and the short ones fill the tail
+            std::vector<int> order(names.size());
+            for (int i = 0; i < static_cast<int>(order.size()); ++i) {
+                order[i] = i;
+            }
+            if (haveHeader) {
+                std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+                    return costModel.predict(header.subsounds[a]) < costModel.predict(header.subsounds[b]);
+                });
+            }
+
+            for (int i : order) {
+                SubsoundHeader subsound = haveHeader ? header.subsounds[i] : SubsoundHeader();
+                pool.submit([&, utf8FilePath, entryDir, outputDir, journal, bankName, haveHeader, subsound, i, name = names[i]]() {
+                    if (shouldCancel()) {
+                        return;
+                    }
+
+                    fs::path outputPath = outputDir / boost::nowide::widen(name + exporters.front()->getExtension());
+                    if (journal && options.resume && journal->isComplete(i, outputPath)) {
+                        ++resumed;
+                        return;
+                    }
+
+                    auto start = std::chrono::steady_clock::now();
+                    SubsoundExporter& exporter = *exporters[WorkStealingPool::workerIndex()];
+                    bool succeeded = false;
+                    if (!journal) {
+                        std::vector<char> wav;
+                        succeeded = exporter.renderFile(utf8FilePath, i, wav);
+                        if (succeeded) {
+                            archive.add(boost::nowide::narrow((entryDir / outputPath.filename()).generic_wstring()), std::move(wav));
+                        }
+                    }
+                    else {
+                        SilenceTrim trim;
+                        trim.threshold = trimThreshold;
+                        succeeded = exporter.exportFile(utf8FilePath, i, outputPath, options.peaks, options.features, trimming ? &trim : nullptr);
+                        if (succeeded && trimming) {
+                            trimReport.add(bankName, i, name, exporter.getFormat().rate, trim);
+                        }
+                    }
+                    if (!succeeded) {
+                        ++failed;
+                        return;
+                    }
+                    if (haveHeader) {
+                        double actual = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                        costReport.add(bankName, i, subsound, costModel.predict(subsound), actual);
+                    }
+
+                    if (journal) {
+                        journal->record(i, outputPath);
+                    }
+                    ++exported;
+                });
+            }
+        });
+    }
+
+    pool.run();
+
+    exporters.clear();
+    if (archive.isOpen() && archive.close()) {
+        std::wcout << L"Archived to " << options.archivePath.wstring() << std::endl;
+    }
+
+    std::wcout << L"Exported " << exported << L" subsounds from " << banks.size() << L" banks";
+    if (resumed) {
+        std::wcout << L", " << resumed << L" already done";
+    }
+    if (failed) {
+        std::wcout << L", " << failed << L" failed";
+    }
+    std::wcout << (shouldCancel() ? L" (cancelled)" : L"") << std::endl;
+    if (!options.costReportPath.empty()) {
+        costReport.write(options.costReportPath);
+    }
+    if (trimming) {
+        trimReport.write(options.trimReportPath);
+    }
+
+    readAheadFiles.report();
+    if (pooled) {
+        printFMODMemory("Run", pooled);
+    }
+    else {
+        fmodPool.report();
+    }
+}
+
+} // namespace fsbtool
@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#include "Archive.h"
+#include "BankReader.h"
+#include "MixOutput.h"
+#include "Options.h"
+
+// Standard C++ headers
+#include <string>
+#include <vector>
+
+namespace fsbtool {
+
+// Must run before the first System_Create. A fixed pool caps FMOD at poolSize bytes,
+// otherwise FMOD goes through fmodPool so usage can be tracked per subsound.
+void initFMOD(uint64_t poolSize);
+void printFMODMemory(const std::string& label, bool pooled);
+
+// Names from the FSB5 name table, or from FMOD opening the bank as a stream when the table is
+// missing or cannot be parsed. Neither decodes any audio.
+std::vector<std::string> readSubsoundNames(const std::string& utf8FilePath);
+
+// Silence cut from one export: threshold is a linear amplitude, and the frame counts are of the
+// decoded clip before trimming. A clip that is silent throughout is all leading.
+struct SilenceTrim {
+    float threshold = 0.0f;
+    uint64_t frames = 0;
+    uint64_t leading = 0;
+    uint64_t trailing = 0;
+};
+
+// Plays subsounds through the mixer into a MixOutput. The System and the bank, opened as a stream,
+// are kept between calls, so a worker exporting many subsounds of one bank opens it once and
+// never holds more of it than the stream buffers.
+class SubsoundExporter {
+public:
+    SubsoundExporter() = default;
+    SubsoundExporter(const SubsoundExporter&) = delete;
+    SubsoundExporter& operator=(const SubsoundExporter&) = delete;
+    ~SubsoundExporter() { close(); }
+
+    // A level of 0-8 makes the files FLAC, encoded on threads threads; a negative level keeps WAV
+    void setFlac(int level, unsigned int threads) { flacLevel = level; flacThreads = threads; }
+    const char* getExtension() const { return flacLevel >= 0 ? ".flac" : ".wav"; }
+
+    // Hands every mixed block of the subsound to sink, in getFormat()
+    bool render(const std::string& utf8FilePath, int index, const MixSink& sink);
+    // The file is written under a temporary name and renamed once complete, so a partial file
+    // never looks finished. For WAV output, writePeaks, features and trim add sidecars and cut
+    // silence from the mixed PCM, as exportClip does for the decoded PCM, so trim counts frames of
+    // the file written.
+    bool exportFile(const std::string& utf8FilePath, int index, const fs::path& outputPath, bool writePeaks = false, const FeatureSettings& features = FeatureSettings(), SilenceTrim* trim = nullptr);
+    // Builds the whole file in memory, for writers such as ArchiveWriter that take finished files
+    bool renderFile(const std::string& utf8FilePath, int index, std::vector<char>& file);
+    void close();
+
+    const WavFormat& getFormat() const { return output.getFormat(); }
+
+private:
+    bool openBank(const std::string& utf8FilePath);
+
+    FMOD::System* system = nullptr;
+    FMOD::Sound* bank = nullptr;
+    std::string bankPath;
+    MixOutput output;
+    int flacLevel = -1;
+    unsigned int flacThreads = 1;
+};
+
+// Exports one subsound through a SubsoundExporter of its own
+void exportSubsound(const std::string& utf8FilePath, int index, const fs::path& outputPath, bool reportMemory, bool pooled);
+
+// Decodes only [start, end) of one subsound. The stream seeks straight to start, so the cost is the
+// clip plus Vorbis pre-roll from the nearest seek point rather than a decode of the whole track.
+// Passing the same decoder for several subsounds of a bank reuses its stream. With writePeaks the
+// decoded PCM also feeds a PeakPyramid saved beside the WAV as .peaks, and with features set a
+// FeatureWriter streaming to .features. With trim, leading and trailing frames with no sample
+// above trim->threshold are left out of the WAV and counted in trim.
+bool exportClip(const BankReader& reader, SubsoundDecoder& decoder, int index, const ClipTime& start, const ClipTime& end, const fs::path& outputPath, bool writePeaks = false, const FeatureSettings& features = FeatureSettings(), SilenceTrim* trim = nullptr);
+
+// Appends the first length of each subsound to one 16 bit WAV, in the given order, with a cue
+// labelled with the subsound name at the start of each. Subsounds at a different rate from the
+// first are left out.
+bool writePreviewReel(const BankReader& reader, const std::vector<int>& subsounds, const ClipTime& length, const fs::path& reelPath, unsigned int jobs);
+
+void dumpFSB(const fs::path& filePath, const ToolOptions& options);
+
+// Every bank under root is exported to a folder mirroring its path. Each bank task queues one
+// task per subsound on its own worker, and idle workers steal them, so one process covers the corpus.
+void dumpAll(const fs::path& root, const ToolOptions& options);
+
+} // namespace fsbtool
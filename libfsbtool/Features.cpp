@@ -0,0 +1,274 @@
+﻿#include "Features.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FSBTOOL_SSE2 1
+#endif
+
+namespace fsbtool {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr uint32_t kFeatureVersion = 1;
+constexpr std::streamoff kFrameCountOffset = 28;
+
+template <typename T>
+void writeValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+double hzToMel(double hz) {
+    return 2595.0 * std::log10(1.0 + hz / 700.0);
+}
+
+double melToHz(double mel) {
+    return 700.0 * (std::pow(10.0, mel / 2595.0) - 1.0);
+}
+
+} // namespace
+
+RealFft::RealFft(unsigned int fftSize) : size(fftSize), half(fftSize / 2) {
+    unsigned int bits = 0;
+    while ((1u << bits) < half) {
+        ++bits;
+    }
+    bitReverse.resize(half);
+    for (unsigned int i = 0; i < half; ++i) {
+        unsigned int reversed = 0;
+        for (unsigned int b = 0; b < bits; ++b) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        bitReverse[i] = reversed;
+    }
+
+    // The stage joining blocks of h keeps its h twiddles from offset h - 1
+    stageCos.resize(half);
+    stageSin.resize(half);
+    for (unsigned int h = 1; h < half; h *= 2) {
+        for (unsigned int j = 0; j < h; ++j) {
+            double angle = -kPi * j / h;
+            stageCos[h - 1 + j] = static_cast<float>(std::cos(angle));
+            stageSin[h - 1 + j] = static_cast<float>(std::sin(angle));
+        }
+    }
+
+    splitCos.resize(half + 1);
+    splitSin.resize(half + 1);
+    for (unsigned int k = 0; k <= half; ++k) {
+        double angle = -2.0 * kPi * k / size;
+        splitCos[k] = static_cast<float>(std::cos(angle));
+        splitSin[k] = static_cast<float>(std::sin(angle));
+    }
+
+    re.resize(half);
+    im.resize(half);
+}
+
+void RealFft::transform() {
+    for (unsigned int h = 1; h < half; h *= 2) {
+        const float* wc = stageCos.data() + h - 1;
+        const float* ws = stageSin.data() + h - 1;
+        for (unsigned int block = 0; block < half; block += 2 * h) {
+            float* ar = re.data() + block;
+            float* ai = im.data() + block;
+            float* cr = ar + h;
+            float* ci = ai + h;
+            unsigned int j = 0;
+#ifdef FSBTOOL_SSE2
+            for (; j + 4 <= h; j += 4) {
+                __m128 xr = _mm_loadu_ps(cr + j);
+                __m128 xi = _mm_loadu_ps(ci + j);
+                __m128 c = _mm_loadu_ps(wc + j);
+                __m128 s = _mm_loadu_ps(ws + j);
+                __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, c), _mm_mul_ps(xi, s));
+                __m128 ti = _mm_add_ps(_mm_mul_ps(xr, s), _mm_mul_ps(xi, c));
+                __m128 yr = _mm_loadu_ps(ar + j);
+                __m128 yi = _mm_loadu_ps(ai + j);
+                _mm_storeu_ps(cr + j, _mm_sub_ps(yr, tr));
+                _mm_storeu_ps(ci + j, _mm_sub_ps(yi, ti));
+                _mm_storeu_ps(ar + j, _mm_add_ps(yr, tr));
+                _mm_storeu_ps(ai + j, _mm_add_ps(yi, ti));
+            }
+#endif
+            for (; j < h; ++j) {
+                float tr = cr[j] * wc[j] - ci[j] * ws[j];
+                float ti = cr[j] * ws[j] + ci[j] * wc[j];
+                cr[j] = ar[j] - tr;
+                ci[j] = ai[j] - ti;
+                ar[j] += tr;
+                ai[j] += ti;
+            }
+        }
+    }
+}
+
+void RealFft::power(const float* input, float* output) {
+    // Even samples as the real part and odd as the imaginary, loaded in bit reversed order
+    for (unsigned int n = 0; n < half; ++n) {
+        re[bitReverse[n]] = input[2 * n];
+        im[bitReverse[n]] = input[2 * n + 1];
+    }
+    transform();
+
+    // Bin k of the real signal is E + W^k O, where E and O are the spectra of the even and
+    // odd samples, recovered from Z[k] and conj(Z[half - k])
+    for (unsigned int k = 0; k <= half; ++k) {
+        unsigned int a = k % half;
+        unsigned int b = (half - k) % half;
+        float evenRe = 0.5f * (re[a] + re[b]);
+        float evenIm = 0.5f * (im[a] - im[b]);
+        float oddRe = 0.5f * (im[a] + im[b]);
+        float oddIm = -0.5f * (re[a] - re[b]);
+        float xr = evenRe + splitCos[k] * oddRe - splitSin[k] * oddIm;
+        float xi = evenIm + splitCos[k] * oddIm + splitSin[k] * oddRe;
+        output[k] = xr * xr + xi * xi;
+    }
+}
+
+bool FeatureWriter::open(const fs::path& outputPath, const FeatureSettings& featureSettings, int channelCount, int sampleRate) {
+    settings = featureSettings;
+    channels = channelCount;
+    rate = sampleRate;
+    totalFrames = 0;
+    featureFrames = 0;
+    pending.clear();
+    pendingOffset = 0;
+
+    unsigned int spectrumBins = settings.window / 2 + 1;
+    bins = settings.kind == FeatureKind::Mel ? settings.mels : spectrumBins;
+    fft = std::make_unique<RealFft>(settings.window);
+    frame.resize(settings.window);
+    spectrum.resize(spectrumBins);
+    values.resize(bins);
+
+    window.resize(settings.window);
+    for (unsigned int i = 0; i < settings.window; ++i) {
+        window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * kPi * i / settings.window));
+    }
+
+    // mels + 2 points evenly spaced in mel give each band its lower edge, centre and upper edge
+    melWeights.assign(settings.kind == FeatureKind::Mel ? static_cast<size_t>(settings.mels) * spectrumBins : 0, 0.0f);
+    if (settings.kind == FeatureKind::Mel) {
+        double top = hzToMel(rate / 2.0);
+        std::vector<double> edges(settings.mels + 2);
+        for (size_t e = 0; e < edges.size(); ++e) {
+            edges[e] = melToHz(top * e / (edges.size() - 1));
+        }
+        for (unsigned int m = 0; m < settings.mels; ++m) {
+            for (unsigned int b = 0; b < spectrumBins; ++b) {
+                double hz = static_cast<double>(b) * rate / settings.window;
+                double weight = 0.0;
+                if (hz > edges[m] && hz <= edges[m + 1]) {
+                    weight = (hz - edges[m]) / (edges[m + 1] - edges[m]);
+                }
+                else if (hz > edges[m + 1] && hz < edges[m + 2]) {
+                    weight = (edges[m + 2] - hz) / (edges[m + 2] - edges[m + 1]);
+                }
+                melWeights[static_cast<size_t>(m) * spectrumBins + b] = static_cast<float>(weight);
+            }
+        }
+    }
+
+    path = outputPath;
+    partPath = outputPath.wstring() + L".part";
+    file.open(partPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::wcerr << L"Failed to create " << partPath.wstring() << std::endl;
+        return false;
+    }
+    file.write("FSBF", 4);
+    writeValue(file, kFeatureVersion);
+    writeValue(file, static_cast<uint32_t>(settings.kind == FeatureKind::Mel ? 2 : 1));
+    writeValue(file, static_cast<uint32_t>(rate));
+    writeValue(file, static_cast<uint32_t>(settings.window));
+    writeValue(file, static_cast<uint32_t>(settings.hop));
+    writeValue(file, static_cast<uint32_t>(bins));
+    writeValue(file, featureFrames);
+    return static_cast<bool>(file);
+}
+
+void FeatureWriter::add(const float* samples, unsigned int frames) {
+    size_t base = pending.size();
+    pending.resize(base + frames);
+    float scale = 1.0f / channels;
+    for (unsigned int f = 0; f < frames; ++f) {
+        const float* in = samples + static_cast<size_t>(f) * channels;
+        float sum = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            sum += in[c];
+        }
+        pending[base + f] = sum * scale;
+    }
+    totalFrames += frames;
+
+    while (pending.size() - pendingOffset >= settings.window) {
+        writeFrame();
+        pendingOffset += settings.hop;
+    }
+
+    // Consumed samples are dropped once they outweigh a window, so the move stays amortised
+    if (pendingOffset >= settings.window) {
+        pending.erase(pending.begin(), pending.begin() + pendingOffset);
+        pendingOffset = 0;
+    }
+}
+
+void FeatureWriter::writeFrame() {
+    size_t available = std::min<size_t>(settings.window, pending.size() - pendingOffset);
+    const float* in = pending.data() + pendingOffset;
+    for (size_t i = 0; i < available; ++i) {
+        frame[i] = in[i] * window[i];
+    }
+    std::fill(frame.begin() + available, frame.end(), 0.0f);
+    fft->power(frame.data(), spectrum.data());
+
+    if (settings.kind == FeatureKind::Mel) {
+        for (unsigned int m = 0; m < bins; ++m) {
+            const float* weights = melWeights.data() + static_cast<size_t>(m) * spectrum.size();
+            double energy = 0.0;
+            for (size_t b = 0; b < spectrum.size(); ++b) {
+                energy += weights[b] * spectrum[b];
+            }
+            values[m] = static_cast<float>(std::log(energy + 1e-10));
+        }
+    }
+    else {
+        for (unsigned int b = 0; b < bins; ++b) {
+            values[b] = std::sqrt(spectrum[b]);
+        }
+    }
+    file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(float)));
+    ++featureFrames;
+}
+
+bool FeatureWriter::close() {
+    // The tail is zero padded until no frame starts before the end
+    while (pendingOffset < pending.size()) {
+        writeFrame();
+        pendingOffset += settings.hop;
+    }
+
+    file.seekp(kFrameCountOffset);
+    writeValue(file, featureFrames);
+    file.close();
+    if (!file) {
+        std::wcerr << L"Failed to write " << partPath.wstring() << std::endl;
+        return false;
+    }
+    fs::rename(partPath, path);
+    return true;
+}
+
+void FeatureWriter::discard() {
+    file.close();
+    boost::system::error_code ec;
+    fs::remove(partPath, ec);
+}
+
+} // namespace fsbtool
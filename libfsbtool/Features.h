@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include "Options.h"
+
+// Standard C++ headers
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+// In-place radix-2 FFT of a real signal, size a power of two, run as a half size complex FFT
+// on split real/imaginary arrays. Butterflies go four at a time with SSE2 when available.
+class RealFft {
+public:
+    explicit RealFft(unsigned int size);
+
+    unsigned int getSize() const { return size; }
+
+    // Squared magnitude of bins 0 to size / 2 of input
+    void power(const float* input, float* output);
+
+private:
+    void transform();
+
+    unsigned int size;
+    unsigned int half;
+    std::vector<unsigned int> bitReverse;
+    // Per stage twiddles for the half size FFT, then the twiddles that split its result
+    std::vector<float> stageCos;
+    std::vector<float> stageSin;
+    std::vector<float> splitCos;
+    std::vector<float> splitSin;
+    std::vector<float> re;
+    std::vector<float> im;
+};
+
+// Streams STFT or log mel features of the channel average, fed with the PCM as it is decoded.
+// Frame k covers samples [k * hop, k * hop + window) under a Hann window, zero padded past the
+// end, and every start before the end gets a frame. The sidecar is "FSBF", then version, kind
+// (1 STFT, 2 mel), rate, window, hop, values per frame and the uint64 frame count, then float32
+// values frame by frame: magnitudes of bins 0 to window / 2, or ln(energy + 1e-10) of each HTK
+// mel band between 0 Hz and Nyquist. All values are little-endian.
+class FeatureWriter {
+public:
+    bool open(const fs::path& path, const FeatureSettings& settings, int channels, int rate);
+    void add(const float* samples, unsigned int frames);
+    bool close();
+    // Closes and deletes the partial sidecar, for an export that failed
+    void discard();
+
+private:
+    void writeFrame();
+
+    FeatureSettings settings;
+    int channels = 0;
+    int rate = 0;
+    // Values per frame
+    unsigned int bins = 0;
+    uint64_t totalFrames = 0;
+    uint64_t featureFrames = 0;
+    std::vector<float> window;
+    // Triangular mel weights, window / 2 + 1 entries per band
+    std::vector<float> melWeights;
+    // Channel average from pending[pendingOffset] on, which is where the next frame starts
+    std::vector<float> pending;
+    size_t pendingOffset = 0;
+    std::vector<float> frame;
+    std::vector<float> spectrum;
+    std::vector<float> values;
+    std::unique_ptr<RealFft> fft;
+    fs::path partPath;
+    fs::path path;
+    fs::ofstream file;
+};
+
+} // namespace fsbtool
@@ -0,0 +1,306 @@
+﻿#include "FileCache.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Boost libraries
+#include <boost/nowide/convert.hpp>
+
+namespace fsbtool {
+
+ReadAheadFileSystem readAheadFiles;
+
+namespace {
+
+FMOD_RESULT F_CALL fileOpen(const char* name, unsigned int* fileSize, void** handle, void*) {
+    return readAheadFiles.open(name, fileSize, handle);
+}
+
+FMOD_RESULT F_CALL fileClose(void* handle, void*) {
+    return readAheadFiles.close(handle);
+}
+
+FMOD_RESULT F_CALL fileRead(void* handle, void* buffer, unsigned int size, unsigned int* bytesRead, void*) {
+    return readAheadFiles.read(handle, buffer, size, bytesRead);
+}
+
+FMOD_RESULT F_CALL fileSeek(void* handle, unsigned int position, void*) {
+    return readAheadFiles.seek(handle, position);
+}
+
+FMOD_RESULT F_CALL fileAsyncRead(FMOD_ASYNCREADINFO* info, void*) {
+    return readAheadFiles.asyncRead(info);
+}
+
+FMOD_RESULT F_CALL fileAsyncCancel(FMOD_ASYNCREADINFO* info, void*) {
+    return readAheadFiles.asyncCancel(info);
+}
+
+} // namespace
+
+ReadAheadFileSystem::~ReadAheadFileSystem() {
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        stopping = true;
+    }
+    queueReady.notify_all();
+    for (auto& thread : ioThreads) {
+        thread.join();
+    }
+}
+
+FMOD_RESULT ReadAheadFileSystem::install(FMOD::System* system) {
+    if (!blockSize) {
+        return FMOD_OK;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        while (ioThreads.size() < kIoThreads) {
+            ioThreads.emplace_back(&ReadAheadFileSystem::ioLoop, this);
+        }
+    }
+
+    // FMOD's own 2 KB buffering stays on; this layer sits underneath it
+    return system->setFileSystem(fileOpen, fileClose, fileRead, fileSeek, fileAsyncRead, fileAsyncCancel, -1);
+}
+
+void ReadAheadFileSystem::addUsage(FMOD::System* system) {
+    long long sample = 0;
+    long long stream = 0;
+    long long other = 0;
+    if (system->getFileUsage(&sample, &stream, &other) == FMOD_OK) {
+        sampleBytes += sample;
+        streamBytes += stream;
+        otherBytes += other;
+    }
+}
+
+void ReadAheadFileSystem::report() const {
+    if (!blockSize) {
+        return;
+    }
+
+    uint64_t calls = readCalls;
+    std::wcout << L"File reads: " << calls << L" FMOD reads for " << bytesRequested / 1024 << L" KB, "
+        << (calls ? 100 * cacheHits / calls : 0) << L"% from cache; " << diskReads << L" disk reads of "
+        << blockSize / 1024 << L" KB blocks for " << diskBytes / 1024 << L" KB, " << prefetchReads << L" of them read-ahead" << std::endl;
+    std::wcout << L"FMOD file usage: sample " << sampleBytes / 1024 << L" KB, stream " << streamBytes / 1024
+        << L" KB, other " << otherBytes / 1024 << L" KB" << std::endl;
+}
+
+FMOD_RESULT ReadAheadFileSystem::open(const char* name, unsigned int* fileSize, void** handle) {
+    auto file = std::make_unique<File>();
+    file->path = boost::nowide::widen(name);
+    file->stream.open(file->path, std::ios::binary);
+    if (!file->stream) {
+        return FMOD_ERR_FILE_NOTFOUND;
+    }
+
+    file->stream.seekg(0, std::ios::end);
+    file->size = static_cast<uint64_t>(file->stream.tellg());
+    *fileSize = static_cast<unsigned int>(std::min<uint64_t>(file->size, UINT32_MAX));
+    *handle = file.release();
+    return FMOD_OK;
+}
+
+FMOD_RESULT ReadAheadFileSystem::close(void* handle) {
+    File* file = static_cast<File*>(handle);
+
+    // Drop its queued read-ahead and wait out any an I/O thread is running
+    std::unique_lock<std::mutex> guard(queueLock);
+    prefetches.erase(std::remove_if(prefetches.begin(), prefetches.end(), [&](const Prefetch& prefetch) {
+        return prefetch.file == file;
+    }), prefetches.end());
+    taskDone.wait(guard, [&]() { return !isBusy(file); });
+    guard.unlock();
+
+    delete file;
+    return FMOD_OK;
+}
+
+FMOD_RESULT ReadAheadFileSystem::read(void* handle, void* buffer, unsigned int size, unsigned int* bytesRead) {
+    File* file = static_cast<File*>(handle);
+    *bytesRead = readAt(*file, file->position, buffer, size);
+    file->position += *bytesRead;
+    return *bytesRead < size ? FMOD_ERR_FILE_EOF : FMOD_OK;
+}
+
+FMOD_RESULT ReadAheadFileSystem::seek(void* handle, unsigned int position) {
+    static_cast<File*>(handle)->position = position;
+    return FMOD_OK;
+}
+
+FMOD_RESULT ReadAheadFileSystem::asyncRead(FMOD_ASYNCREADINFO* info) {
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        reads.push_back(info);
+    }
+    queueReady.notify_one();
+    return FMOD_OK;
+}
+
+FMOD_RESULT ReadAheadFileSystem::asyncCancel(FMOD_ASYNCREADINFO* info) {
+    std::unique_lock<std::mutex> guard(queueLock);
+    auto queued = std::find(reads.begin(), reads.end(), info);
+    if (queued != reads.end()) {
+        reads.erase(queued);
+        guard.unlock();
+        info->done(info, FMOD_ERR_FILE_DISKEJECTED);
+        return FMOD_OK;
+    }
+
+    // Already being read, FMOD must not reuse info until done has been called
+    taskDone.wait(guard, [&]() { return std::find(busyReads.begin(), busyReads.end(), info) == busyReads.end(); });
+    return FMOD_OK;
+}
+
+ReadAheadFileSystem::Block* ReadAheadFileSystem::findBlock(File& file, uint64_t start) {
+    for (auto& block : file.blocks) {
+        if (block.start == start) {
+            return &block;
+        }
+    }
+    return nullptr;
+}
+
+ReadAheadFileSystem::Block& ReadAheadFileSystem::evictBlock(File& file) {
+    return *std::min_element(std::begin(file.blocks), std::end(file.blocks), [](const Block& a, const Block& b) {
+        return a.lastUse < b.lastUse;
+    });
+}
+
+bool ReadAheadFileSystem::isBusy(const File* file) const {
+    return std::find(busyFiles.begin(), busyFiles.end(), file) != busyFiles.end();
+}
+
+// The oldest queued read-ahead of a file no other thread is prefetching. Caller holds queueLock.
+std::deque<ReadAheadFileSystem::Prefetch>::iterator ReadAheadFileSystem::nextPrefetch() {
+    return std::find_if(prefetches.begin(), prefetches.end(), [&](const Prefetch& prefetch) {
+        return !isBusy(prefetch.file);
+    });
+}
+
+unsigned int ReadAheadFileSystem::readAt(File& file, uint64_t offset, void* buffer, unsigned int size) {
+    std::unique_lock<std::mutex> guard(file.lock);
+    char* out = static_cast<char*>(buffer);
+    unsigned int copied = 0;
+    bool hit = true;
+
+    while (copied < size && offset < file.size) {
+        uint64_t start = offset / blockSize * blockSize;
+        Block* block = findBlock(file, start);
+        if (!block) {
+            hit = false;
+            block = &evictBlock(file);
+            block->start = start;
+            block->data.resize(static_cast<size_t>(std::min<uint64_t>(blockSize, file.size - start)));
+            file.stream.clear();
+            file.stream.seekg(static_cast<std::streamoff>(start));
+            file.stream.read(block->data.data(), block->data.size());
+            block->data.resize(static_cast<size_t>(file.stream.gcount()));
+            ++diskReads;
+            diskBytes += block->data.size();
+        }
+        block->lastUse = ++file.useCounter;
+
+        uint64_t available = block->start + block->data.size() > offset ? block->start + block->data.size() - offset : 0;
+        unsigned int take = static_cast<unsigned int>(std::min<uint64_t>(size - copied, available));
+        if (take == 0) {
+            break;
+        }
+        memcpy(out + copied, block->data.data() + (offset - block->start), take);
+        copied += take;
+        offset += take;
+    }
+
+    ++readCalls;
+    bytesRequested += copied;
+    if (hit) {
+        ++cacheHits;
+    }
+
+    // Queue the block after this read unless it is cached or already on its way
+    uint64_t next = (offset ? offset - 1 : 0) / blockSize * blockSize + blockSize;
+    bool queue = next < file.size && !findBlock(file, next) && file.prefetchQueued != next;
+    if (queue) {
+        file.prefetchQueued = next;
+    }
+    guard.unlock();
+
+    if (queue) {
+        {
+            std::lock_guard<std::mutex> queueGuard(queueLock);
+            prefetches.push_back({ &file, next });
+        }
+        queueReady.notify_one();
+    }
+    return copied;
+}
+
+void ReadAheadFileSystem::ioLoop() {
+    std::unique_lock<std::mutex> guard(queueLock);
+
+    while (true) {
+        queueReady.wait(guard, [&]() { return stopping || !reads.empty() || nextPrefetch() != prefetches.end(); });
+        if (stopping) {
+            return;
+        }
+
+        // FMOD's reads are waited on, read-ahead is not, so reads go first
+        if (!reads.empty()) {
+            FMOD_ASYNCREADINFO* info = reads.front();
+            reads.pop_front();
+            busyReads.push_back(info);
+            guard.unlock();
+
+            info->bytesread = readAt(*static_cast<File*>(info->handle), info->offset, info->buffer, info->sizebytes);
+            info->done(info, info->bytesread < info->sizebytes ? FMOD_ERR_FILE_EOF : FMOD_OK);
+
+            guard.lock();
+            busyReads.erase(std::find(busyReads.begin(), busyReads.end(), info));
+            taskDone.notify_all();
+            continue;
+        }
+
+        auto queued = nextPrefetch();
+        Prefetch prefetch = *queued;
+        prefetches.erase(queued);
+        File& file = *prefetch.file;
+        busyFiles.push_back(&file);
+        guard.unlock();
+
+        if (!file.prefetchStream.is_open()) {
+            file.prefetchStream.open(file.path, std::ios::binary);
+        }
+        std::vector<char> data(static_cast<size_t>(std::min<uint64_t>(blockSize, file.size - prefetch.start)));
+        file.prefetchStream.clear();
+        file.prefetchStream.seekg(static_cast<std::streamoff>(prefetch.start));
+        file.prefetchStream.read(data.data(), data.size());
+        data.resize(static_cast<size_t>(file.prefetchStream.gcount()));
+        ++diskReads;
+        ++prefetchReads;
+        diskBytes += data.size();
+
+        {
+            std::lock_guard<std::mutex> fileGuard(file.lock);
+            if (!findBlock(file, prefetch.start)) {
+                Block& block = evictBlock(file);
+                block.start = prefetch.start;
+                block.data.swap(data);
+                block.lastUse = ++file.useCounter;
+            }
+            file.prefetchQueued = UINT64_MAX;
+        }
+
+        guard.lock();
+        busyFiles.erase(std::find(busyFiles.begin(), busyFiles.end(), &file));
+        taskDone.notify_all();
+        // Read-ahead of this file held back while it was busy can now go
+        queueReady.notify_all();
+    }
+}
+
+} // namespace fsbtool
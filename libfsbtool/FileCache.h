@@ -0,0 +1,110 @@
+﻿#pragma once
+
+// FMOD headers
+#include "FMOD/fmod.hpp"
+
+// Standard C++ headers
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+// File layer for FMOD that turns its small reads into large aligned block reads. Each open file
+// keeps kBlocksPerFile blocks, and every read queues the block after it on a pool of kIoThreads
+// background threads, so the next one is usually in memory before FMOD asks. The same threads
+// serve FMOD's asynchronous reads, so one System's slow read does not hold up the others.
+class ReadAheadFileSystem {
+public:
+    static constexpr unsigned int kBlocksPerFile = 4;
+    static constexpr unsigned int kIoThreads = 4;
+
+    ~ReadAheadFileSystem();
+
+    // 0 leaves FMOD on its own file layer
+    void setBlockSize(unsigned int bytes) { blockSize = bytes; }
+    unsigned int getBlockSize() const { return blockSize; }
+
+    // Must be called before System::init. Does nothing while the block size is 0.
+    FMOD_RESULT install(FMOD::System* system);
+    // Adds System::getFileUsage of a System that is about to be released
+    void addUsage(FMOD::System* system);
+    void report() const;
+
+    FMOD_RESULT open(const char* name, unsigned int* fileSize, void** handle);
+    FMOD_RESULT close(void* handle);
+    FMOD_RESULT read(void* handle, void* buffer, unsigned int size, unsigned int* bytesRead);
+    FMOD_RESULT seek(void* handle, unsigned int position);
+    FMOD_RESULT asyncRead(FMOD_ASYNCREADINFO* info);
+    FMOD_RESULT asyncCancel(FMOD_ASYNCREADINFO* info);
+
+private:
+    struct Block {
+        uint64_t start = UINT64_MAX;
+        uint64_t lastUse = 0;
+        std::vector<char> data;
+    };
+
+    struct File {
+        std::mutex lock;
+        fs::ifstream stream;
+        // Only used by the I/O thread prefetching the file, so prefetching never holds the file
+        // lock during a read. At most one thread prefetches a file at a time.
+        fs::ifstream prefetchStream;
+        fs::path path;
+        uint64_t size = 0;
+        uint64_t position = 0;
+        uint64_t useCounter = 0;
+        uint64_t prefetchQueued = UINT64_MAX;
+        Block blocks[kBlocksPerFile];
+    };
+
+    struct Prefetch {
+        File* file;
+        uint64_t start;
+    };
+
+    unsigned int readAt(File& file, uint64_t offset, void* buffer, unsigned int size);
+    Block* findBlock(File& file, uint64_t start);
+    Block& evictBlock(File& file);
+    bool isBusy(const File* file) const;
+    std::deque<Prefetch>::iterator nextPrefetch();
+    void ioLoop();
+
+    unsigned int blockSize = 0;
+
+    std::mutex queueLock;
+    std::condition_variable queueReady;
+    std::condition_variable taskDone;
+    std::deque<FMOD_ASYNCREADINFO*> reads;
+    std::deque<Prefetch> prefetches;
+    // What each I/O thread is working on
+    std::vector<const File*> busyFiles;
+    std::vector<FMOD_ASYNCREADINFO*> busyReads;
+    bool stopping = false;
+    std::vector<std::thread> ioThreads;
+
+    std::atomic<uint64_t> readCalls = 0;
+    std::atomic<uint64_t> bytesRequested = 0;
+    std::atomic<uint64_t> cacheHits = 0;
+    std::atomic<uint64_t> diskReads = 0;
+    std::atomic<uint64_t> diskBytes = 0;
+    std::atomic<uint64_t> prefetchReads = 0;
+    std::atomic<int64_t> sampleBytes = 0;
+    std::atomic<int64_t> streamBytes = 0;
+    std::atomic<int64_t> otherBytes = 0;
+};
+
+extern ReadAheadFileSystem readAheadFiles;
+
+} // namespace fsbtool
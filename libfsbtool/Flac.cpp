@@ -0,0 +1,699 @@
+﻿#include "Flac.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <thread>
+
+namespace fsbtool {
+
+namespace {
+
+struct Settings {
+    bool stereo = false;
+    std::vector<int> lpcOrders;
+    int maxPartitionOrder = 3;
+    int lpcPrecision = 14;
+};
+
+Settings settingsFor(int level, int bits) {
+    static const std::vector<int> lpcOrders[] = {
+        {}, {}, {}, { 8 }, { 4, 8 }, { 2, 4, 6, 8 }, { 4, 8, 12 }, { 2, 4, 6, 8, 10, 12 }, { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 }
+    };
+    static const int partitionOrders[] = { 3, 4, 4, 4, 5, 5, 6, 6, 8 };
+
+    Settings settings;
+    level = std::clamp(level, 0, 8);
+    // A side channel needs one bit more than the input, which 32 bit input does not have
+    settings.stereo = level > 0 && bits < 32;
+    settings.lpcOrders = lpcOrders[level];
+    settings.maxPartitionOrder = partitionOrders[level];
+    settings.lpcPrecision = bits <= 8 ? 12 : bits <= 16 ? 14 : 15;
+    return settings;
+}
+
+class BitWriter {
+public:
+    // Up to 32 bits, most significant first
+    void write(uint32_t value, int bits) {
+        if (bits == 0) {
+            return;
+        }
+        accumulator = (accumulator << bits) | (value & (0xFFFFFFFFull >> (32 - bits)));
+        count += bits;
+        while (count >= 8) {
+            count -= 8;
+            bytes.push_back(static_cast<uint8_t>(accumulator >> count));
+        }
+    }
+
+    void writeRice(int32_t residual, int parameter) {
+        uint32_t folded = (static_cast<uint32_t>(residual) << 1) ^ static_cast<uint32_t>(residual >> 31);
+        uint32_t zeros = folded >> parameter;
+        while (zeros >= 32) {
+            write(0, 32);
+            zeros -= 32;
+        }
+        write(1, zeros + 1);
+        write(folded, parameter);
+    }
+
+    void align() {
+        if (count) {
+            write(0, 8 - count);
+        }
+    }
+
+    std::vector<uint8_t>& getBytes() { return bytes; }
+
+private:
+    std::vector<uint8_t> bytes;
+    uint64_t accumulator = 0;
+    int count = 0;
+};
+
+uint8_t crc8(const uint8_t* data, size_t size) {
+    static const auto table = []() {
+        std::array<uint8_t, 256> entries = {};
+        for (int i = 0; i < 256; ++i) {
+            uint8_t crc = static_cast<uint8_t>(i);
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = static_cast<uint8_t>((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+            }
+            entries[i] = crc;
+        }
+        return entries;
+    }();
+
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[crc ^ data[i]];
+    }
+    return crc;
+}
+
+uint16_t crc16(const uint8_t* data, size_t size) {
+    static const auto table = []() {
+        std::array<uint16_t, 256> entries = {};
+        for (int i = 0; i < 256; ++i) {
+            uint16_t crc = static_cast<uint16_t>(i << 8);
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = static_cast<uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1);
+            }
+            entries[i] = crc;
+        }
+        return entries;
+    }();
+
+    uint16_t crc = 0;
+    for (size_t i = 0; i < size; ++i) {
+        crc = static_cast<uint16_t>((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+    }
+    return crc;
+}
+
+struct Subframe {
+    enum class Type { Constant, Verbatim, Fixed, Lpc };
+
+    Type type = Type::Verbatim;
+    int order = 0;
+    int precision = 0;
+    int shift = 0;
+    std::vector<int32_t> coefficients;
+    std::vector<int32_t> residual;
+    int partitionOrder = 0;
+    std::vector<int> parameters;
+    bool rice2 = false;
+    uint64_t bits = UINT64_MAX;
+};
+
+// Picks the partition order and Rice parameters for a residual, returning the estimated bits.
+// Sums are taken at the finest order and merged pairwise for each coarser one.
+uint64_t chooseRice(const std::vector<int32_t>& residual, unsigned int blockSize, int order, int maxPartitionOrder, Subframe& subframe) {
+    int finest = 0;
+    while (finest < maxPartitionOrder && (blockSize % (2u << finest)) == 0 && (blockSize >> (finest + 1)) > static_cast<unsigned int>(order)) {
+        ++finest;
+    }
+
+    std::vector<uint64_t> sums(size_t(1) << finest, 0);
+    std::vector<unsigned int> counts(sums.size(), blockSize >> finest);
+    counts[0] -= order;
+    size_t position = 0;
+    for (size_t p = 0; p < sums.size(); ++p) {
+        for (unsigned int i = 0; i < counts[p]; ++i, ++position) {
+            int32_t value = residual[position];
+            sums[p] += (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+        }
+    }
+
+    uint64_t bestBits = UINT64_MAX;
+    for (int partitionOrder = finest; partitionOrder >= 0; --partitionOrder) {
+        std::vector<int> parameters(sums.size());
+        uint64_t bits = 2 + 4;
+        bool rice2 = false;
+        for (size_t p = 0; p < sums.size(); ++p) {
+            uint64_t n = counts[p];
+            uint64_t mean = n ? sums[p] / n : 0;
+            int parameter = 0;
+            while (parameter < 30 && (mean >> parameter) > 0) {
+                ++parameter;
+            }
+
+            // The estimate is flat near its minimum, so one step down is worth checking
+            uint64_t best = UINT64_MAX;
+            for (int k = std::max(parameter - 1, 0); k <= parameter; ++k) {
+                uint64_t cost = n * (k + 1) + (sums[p] >> k);
+                if (cost < best) {
+                    best = cost;
+                    parameters[p] = k;
+                }
+            }
+            bits += best;
+            rice2 = rice2 || parameters[p] > 14;
+        }
+        bits += sums.size() * (rice2 ? 5 : 4);
+
+        if (bits < bestBits) {
+            bestBits = bits;
+            subframe.partitionOrder = partitionOrder;
+            subframe.parameters = parameters;
+            subframe.rice2 = rice2;
+        }
+
+        for (size_t p = 0; p < sums.size() / 2; ++p) {
+            sums[p] = sums[2 * p] + sums[2 * p + 1];
+            counts[p] = counts[2 * p] + counts[2 * p + 1];
+        }
+        sums.resize(sums.size() / 2);
+        counts.resize(counts.size() / 2);
+    }
+    return bestBits;
+}
+
+bool fitsResidual(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+void fixedResidual(const int32_t* samples, unsigned int n, int order, std::vector<int64_t>& residual) {
+    residual.resize(n - order);
+    for (unsigned int i = order; i < n; ++i) {
+        int64_t x0 = samples[i];
+        int64_t prediction = 0;
+        switch (order) {
+        case 1: prediction = samples[i - 1]; break;
+        case 2: prediction = 2 * int64_t(samples[i - 1]) - samples[i - 2]; break;
+        case 3: prediction = 3 * (int64_t(samples[i - 1]) - samples[i - 2]) + samples[i - 3]; break;
+        case 4: prediction = 4 * (int64_t(samples[i - 1]) + samples[i - 3]) - 6 * int64_t(samples[i - 2]) - samples[i - 4]; break;
+        }
+        residual[i - order] = x0 - prediction;
+    }
+}
+
+// Levinson-Durbin on the autocorrelation, leaving the predictor for every order up to maxOrder
+int computeLpc(const int32_t* samples, unsigned int n, int maxOrder, std::vector<std::vector<double>>& predictors) {
+    // Tukey(0.5) window
+    std::vector<double> windowed(n);
+    double taper = n * 0.25;
+    for (unsigned int i = 0; i < n; ++i) {
+        double w = 1.0;
+        if (i < taper) {
+            w = 0.5 - 0.5 * std::cos(3.14159265358979323846 * i / taper);
+        }
+        else if (i >= n - taper) {
+            w = 0.5 - 0.5 * std::cos(3.14159265358979323846 * (n - 1 - i) / taper);
+        }
+        windowed[i] = samples[i] * w;
+    }
+
+    std::vector<double> autoc(maxOrder + 1, 0.0);
+    for (int lag = 0; lag <= maxOrder; ++lag) {
+        double sum = 0.0;
+        for (unsigned int i = lag; i < n; ++i) {
+            sum += windowed[i] * windowed[i - lag];
+        }
+        autoc[lag] = sum;
+    }
+    if (autoc[0] == 0.0) {
+        return 0;
+    }
+
+    std::vector<double> lpc(maxOrder, 0.0);
+    double error = autoc[0];
+    predictors.assign(maxOrder + 1, {});
+    for (int i = 0; i < maxOrder; ++i) {
+        double r = -autoc[i + 1];
+        for (int j = 0; j < i; ++j) {
+            r -= lpc[j] * autoc[i - j];
+        }
+        r /= error;
+
+        lpc[i] = r;
+        int j = 0;
+        for (; j < (i >> 1); ++j) {
+            double tmp = lpc[j];
+            lpc[j] += r * lpc[i - 1 - j];
+            lpc[i - 1 - j] += r * tmp;
+        }
+        if (i & 1) {
+            lpc[j] += lpc[j] * r;
+        }
+        error *= 1.0 - r * r;
+
+        predictors[i + 1].resize(i + 1);
+        for (j = 0; j <= i; ++j) {
+            predictors[i + 1][j] = -lpc[j];
+        }
+        if (error <= 0.0) {
+            return i + 1;
+        }
+    }
+    return maxOrder;
+}
+
+bool quantizeLpc(const std::vector<double>& predictor, int precision, std::vector<int32_t>& coefficients, int& shift) {
+    double largest = 0.0;
+    for (double c : predictor) {
+        largest = std::max(largest, std::fabs(c));
+    }
+    if (largest <= 0.0) {
+        return false;
+    }
+
+    int log2Largest = 0;
+    std::frexp(largest, &log2Largest);
+    --log2Largest;
+    shift = std::min(precision - 1 - log2Largest - 1, 15);
+    if (shift < 0) {
+        return false;
+    }
+
+    // Rounding error is carried into the next coefficient
+    int32_t qmax = (1 << (precision - 1)) - 1;
+    int32_t qmin = -(1 << (precision - 1));
+    double error = 0.0;
+    coefficients.resize(predictor.size());
+    for (size_t i = 0; i < predictor.size(); ++i) {
+        error += predictor[i] * (1 << shift);
+        int32_t q = static_cast<int32_t>(std::lround(error));
+        q = std::clamp(q, qmin, qmax);
+        error -= q;
+        coefficients[i] = q;
+    }
+    return true;
+}
+
+void lpcResidual(const int32_t* samples, unsigned int n, const std::vector<int32_t>& coefficients, int shift, std::vector<int64_t>& residual) {
+    int order = static_cast<int>(coefficients.size());
+    residual.resize(n - order);
+    for (unsigned int i = order; i < n; ++i) {
+        int64_t sum = 0;
+        for (int j = 0; j < order; ++j) {
+            sum += int64_t(coefficients[j]) * samples[i - j - 1];
+        }
+        residual[i - order] = samples[i] - (sum >> shift);
+    }
+}
+
+// Keeps candidate as the best subframe when its residual fits and codes smaller
+void tryResidual(const std::vector<int64_t>& wide, unsigned int n, int bps, int headerBits, const Settings& settings, Subframe& candidate, Subframe& best) {
+    candidate.residual.resize(wide.size());
+    for (size_t i = 0; i < wide.size(); ++i) {
+        if (!fitsResidual(wide[i])) {
+            return;
+        }
+        candidate.residual[i] = static_cast<int32_t>(wide[i]);
+    }
+
+    uint64_t bits = 8 + uint64_t(candidate.order) * bps + headerBits + chooseRice(candidate.residual, n, candidate.order, settings.maxPartitionOrder, candidate);
+    if (bits < best.bits) {
+        candidate.bits = bits;
+        std::swap(candidate, best);
+    }
+}
+
+void analyseChannel(const int32_t* samples, unsigned int n, int bps, const Settings& settings, Subframe& best) {
+    best = Subframe();
+    best.type = Subframe::Type::Verbatim;
+    best.bits = 8 + uint64_t(n) * bps;
+
+    if (std::all_of(samples, samples + n, [&](int32_t s) { return s == samples[0]; })) {
+        best.type = Subframe::Type::Constant;
+        best.bits = 8 + bps;
+        return;
+    }
+
+    Subframe candidate;
+    std::vector<int64_t> wide;
+    for (int order = 0; order <= 4 && order < static_cast<int>(n); ++order) {
+        fixedResidual(samples, n, order, wide);
+        candidate.type = Subframe::Type::Fixed;
+        candidate.order = order;
+        tryResidual(wide, n, bps, 0, settings, candidate, best);
+    }
+
+    int maxOrder = 0;
+    for (int order : settings.lpcOrders) {
+        if (order < static_cast<int>(n)) {
+            maxOrder = std::max(maxOrder, order);
+        }
+    }
+    std::vector<std::vector<double>> predictors;
+    int computed = maxOrder ? computeLpc(samples, n, maxOrder, predictors) : 0;
+    for (int order : settings.lpcOrders) {
+        if (order > computed) {
+            continue;
+        }
+
+        candidate.type = Subframe::Type::Lpc;
+        candidate.order = order;
+        candidate.precision = settings.lpcPrecision;
+        if (!quantizeLpc(predictors[order], candidate.precision, candidate.coefficients, candidate.shift)) {
+            continue;
+        }
+        lpcResidual(samples, n, candidate.coefficients, candidate.shift, wide);
+        tryResidual(wide, n, bps, 4 + 5 + order * candidate.precision, settings, candidate, best);
+    }
+}
+
+void writeSubframe(BitWriter& bits, const int32_t* samples, unsigned int n, int bps, const Subframe& subframe) {
+    switch (subframe.type) {
+    case Subframe::Type::Constant:
+        bits.write(0x00 << 1, 8);
+        bits.write(static_cast<uint32_t>(samples[0]), bps);
+        return;
+    case Subframe::Type::Verbatim:
+        bits.write(0x01 << 1, 8);
+        for (unsigned int i = 0; i < n; ++i) {
+            bits.write(static_cast<uint32_t>(samples[i]), bps);
+        }
+        return;
+    case Subframe::Type::Fixed:
+        bits.write((0x08 | subframe.order) << 1, 8);
+        break;
+    case Subframe::Type::Lpc:
+        bits.write((0x20 | (subframe.order - 1)) << 1, 8);
+        break;
+    }
+
+    for (int i = 0; i < subframe.order; ++i) {
+        bits.write(static_cast<uint32_t>(samples[i]), bps);
+    }
+    if (subframe.type == Subframe::Type::Lpc) {
+        bits.write(subframe.precision - 1, 4);
+        bits.write(subframe.shift, 5);
+        for (int32_t coefficient : subframe.coefficients) {
+            bits.write(static_cast<uint32_t>(coefficient), subframe.precision);
+        }
+    }
+
+    bits.write(subframe.rice2 ? 1 : 0, 2);
+    bits.write(subframe.partitionOrder, 4);
+    size_t position = 0;
+    size_t partitions = size_t(1) << subframe.partitionOrder;
+    for (size_t p = 0; p < partitions; ++p) {
+        size_t count = (n >> subframe.partitionOrder) - (p == 0 ? subframe.order : 0);
+        int parameter = subframe.parameters[p];
+        bits.write(parameter, subframe.rice2 ? 5 : 4);
+        for (size_t i = 0; i < count; ++i) {
+            bits.writeRice(subframe.residual[position++], parameter);
+        }
+    }
+}
+
+void writeFrameNumber(BitWriter& bits, uint32_t number) {
+    if (number < 0x80) {
+        bits.write(number, 8);
+        return;
+    }
+
+    // UTF-8 style: a lead byte giving the length, then six bits per continuation byte
+    int continuation = number < 0x800 ? 1 : number < 0x10000 ? 2 : number < 0x200000 ? 3 : number < 0x4000000 ? 4 : 5;
+    uint32_t lead = (0xFF00 >> (continuation + 1)) & 0xFF;
+    bits.write(lead | (number >> (6 * continuation)), 8);
+    for (int i = continuation - 1; i >= 0; --i) {
+        bits.write(0x80 | ((number >> (6 * i)) & 0x3F), 8);
+    }
+}
+
+int sampleRateCode(int rate, uint32_t& extra, int& extraBits) {
+    static const int rates[] = { 0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000 };
+    for (int code = 1; code < 12; ++code) {
+        if (rates[code] == rate) {
+            extraBits = 0;
+            return code;
+        }
+    }
+    if (rate % 1000 == 0 && rate / 1000 < 256) {
+        extra = rate / 1000;
+        extraBits = 8;
+        return 12;
+    }
+    if (rate < 65536) {
+        extra = rate;
+        extraBits = 16;
+        return 13;
+    }
+    extraBits = 0;
+    return 0;
+}
+
+int sampleSizeCode(int bits) {
+    switch (bits) {
+    case 8: return 1;
+    case 12: return 2;
+    case 16: return 4;
+    case 20: return 5;
+    case 24: return 6;
+    default: return 7;
+    }
+}
+
+std::vector<uint8_t> encodeFrame(const int32_t* interleaved, unsigned int n, const WavFormat& format, const Settings& settings, uint32_t number) {
+    int channels = format.channels;
+    std::vector<std::vector<int32_t>> planes(channels, std::vector<int32_t>(n));
+    for (unsigned int i = 0; i < n; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            planes[c][i] = interleaved[static_cast<size_t>(i) * channels + c];
+        }
+    }
+
+    // Assignment 0-7 is independent channels; 8 left/side, 9 side/right, 10 mid/side
+    int assignment = channels - 1;
+    std::vector<Subframe> subframes(channels);
+    std::vector<const int32_t*> sources(channels);
+    std::vector<int> depths(channels, format.bits);
+    for (int c = 0; c < channels; ++c) {
+        analyseChannel(planes[c].data(), n, format.bits, settings, subframes[c]);
+        sources[c] = planes[c].data();
+    }
+
+    std::vector<int32_t> mid;
+    std::vector<int32_t> side;
+    if (channels == 2 && settings.stereo) {
+        mid.resize(n);
+        side.resize(n);
+        for (unsigned int i = 0; i < n; ++i) {
+            int64_t left = planes[0][i];
+            int64_t right = planes[1][i];
+            mid[i] = static_cast<int32_t>((left + right) >> 1);
+            side[i] = static_cast<int32_t>(left - right);
+        }
+
+        Subframe midFrame;
+        Subframe sideFrame;
+        analyseChannel(mid.data(), n, format.bits, settings, midFrame);
+        analyseChannel(side.data(), n, format.bits + 1, settings, sideFrame);
+
+        uint64_t left = subframes[0].bits;
+        uint64_t right = subframes[1].bits;
+        uint64_t costs[] = { left + right, left + sideFrame.bits, sideFrame.bits + right, midFrame.bits + sideFrame.bits };
+        int choice = static_cast<int>(std::min_element(std::begin(costs), std::end(costs)) - std::begin(costs));
+        if (choice == 1) {
+            assignment = 8;
+            subframes[1] = std::move(sideFrame);
+            sources[1] = side.data();
+            depths[1] = format.bits + 1;
+        }
+        else if (choice == 2) {
+            assignment = 9;
+            subframes[0] = std::move(sideFrame);
+            sources[0] = side.data();
+            depths[0] = format.bits + 1;
+        }
+        else if (choice == 3) {
+            assignment = 10;
+            subframes[0] = std::move(midFrame);
+            subframes[1] = std::move(sideFrame);
+            sources[0] = mid.data();
+            sources[1] = side.data();
+            depths[1] = format.bits + 1;
+        }
+    }
+
+    BitWriter bits;
+    uint32_t rateExtra = 0;
+    int rateExtraBits = 0;
+    int rateCode = sampleRateCode(format.rate, rateExtra, rateExtraBits);
+    bool fullBlock = n == FlacEncoder::kBlockSize;
+
+    bits.write(0xFFF8, 16);
+    bits.write(fullBlock ? 12 : 7, 4);
+    bits.write(rateCode, 4);
+    bits.write(assignment, 4);
+    bits.write(sampleSizeCode(format.bits), 3);
+    bits.write(0, 1);
+    writeFrameNumber(bits, number);
+    if (!fullBlock) {
+        bits.write(n - 1, 16);
+    }
+    bits.write(rateExtra, rateExtraBits);
+    bits.write(crc8(bits.getBytes().data(), bits.getBytes().size()), 8);
+
+    for (int c = 0; c < channels; ++c) {
+        writeSubframe(bits, sources[c], n, depths[c], subframes[c]);
+    }
+    bits.align();
+    uint16_t crc = crc16(bits.getBytes().data(), bits.getBytes().size());
+    bits.write(crc, 16);
+    return std::move(bits.getBytes());
+}
+
+} // namespace
+
+bool FlacEncoder::open(std::ostream& stream, const WavFormat& wavFormat, int compression, unsigned int threadCount) {
+    close();
+
+    if (wavFormat.isFloat || wavFormat.channels < 1 || wavFormat.channels > 8 || wavFormat.rate <= 0 || wavFormat.rate >= (1 << 20)
+        || (wavFormat.bits != 8 && wavFormat.bits != 16 && wavFormat.bits != 24 && wavFormat.bits != 32)) {
+        return false;
+    }
+
+    out = &stream;
+    format = wavFormat;
+    level = compression;
+    threads = std::max(1u, threadCount);
+    pending.clear();
+    totalFrames = 0;
+    frameNumber = 0;
+    minFrameBytes = 0;
+    maxFrameBytes = 0;
+
+    // STREAMINFO is the only metadata block; its sizes are unknown until close
+    out->write("fLaC", 4);
+    out->put(static_cast<char>(0x80));
+    out->put(0);
+    out->put(0);
+    out->put(34);
+    streamInfoPos = out->tellp();
+    writeStreamInfo();
+    return static_cast<bool>(*out);
+}
+
+void FlacEncoder::write(const void* data, unsigned int frames) {
+    if (!out) {
+        return;
+    }
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    size_t samples = static_cast<size_t>(frames) * format.channels;
+    size_t start = pending.size();
+    pending.resize(start + samples);
+    for (size_t i = 0; i < samples; ++i) {
+        switch (format.bits) {
+        case 8:
+            pending[start + i] = int32_t(bytes[i]) - 128;
+            break;
+        case 16:
+            pending[start + i] = int16_t(bytes[2 * i] | (bytes[2 * i + 1] << 8));
+            break;
+        case 24:
+            pending[start + i] = int32_t(uint32_t(bytes[3 * i]) << 8 | uint32_t(bytes[3 * i + 1]) << 16 | uint32_t(bytes[3 * i + 2]) << 24) >> 8;
+            break;
+        default:
+            memcpy(&pending[start + i], bytes + 4 * i, 4);
+            break;
+        }
+    }
+    totalFrames += frames;
+
+    size_t batchFrames = static_cast<size_t>(threads) * kBlocksPerThread * kBlockSize;
+    while (pending.size() / format.channels >= batchFrames) {
+        encodeBatch(batchFrames);
+    }
+}
+
+bool FlacEncoder::close() {
+    if (!out) {
+        return false;
+    }
+
+    if (!pending.empty()) {
+        encodeBatch(pending.size() / format.channels);
+    }
+    if (streamInfoPos != std::streampos(-1)) {
+        out->seekp(streamInfoPos);
+        writeStreamInfo();
+        out->seekp(0, std::ios::end);
+    }
+
+    bool ok = static_cast<bool>(*out);
+    out = nullptr;
+    return ok;
+}
+
+void FlacEncoder::encodeBatch(size_t frames) {
+    size_t blocks = (frames + kBlockSize - 1) / kBlockSize;
+    Settings settings = settingsFor(level, format.bits);
+    std::vector<std::vector<uint8_t>> encoded(blocks);
+    std::atomic<size_t> next = 0;
+
+    auto work = [&]() {
+        for (size_t b = next++; b < blocks; b = next++) {
+            size_t first = b * kBlockSize;
+            unsigned int n = static_cast<unsigned int>(std::min<size_t>(kBlockSize, frames - first));
+            encoded[b] = encodeFrame(pending.data() + first * format.channels, n, format, settings, frameNumber + static_cast<uint32_t>(b));
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t j = 1; j < std::min<size_t>(threads, blocks); ++j) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (const auto& frame : encoded) {
+        out->write(reinterpret_cast<const char*>(frame.data()), static_cast<std::streamsize>(frame.size()));
+        uint32_t size = static_cast<uint32_t>(frame.size());
+        minFrameBytes = minFrameBytes ? std::min(minFrameBytes, size) : size;
+        maxFrameBytes = std::max(maxFrameBytes, size);
+    }
+    frameNumber += static_cast<uint32_t>(blocks);
+    pending.erase(pending.begin(), pending.begin() + frames * format.channels);
+}
+
+void FlacEncoder::writeStreamInfo() {
+    BitWriter info;
+    info.write(kBlockSize, 16);
+    info.write(kBlockSize, 16);
+    info.write(minFrameBytes, 24);
+    info.write(maxFrameBytes, 24);
+    info.write(format.rate, 20);
+    info.write(format.channels - 1, 3);
+    info.write(format.bits - 1, 5);
+    info.write(static_cast<uint32_t>(totalFrames >> 32), 4);
+    info.write(static_cast<uint32_t>(totalFrames), 32);
+    // No MD5 of the audio; all zeros means it was not computed
+    for (int i = 0; i < 4; ++i) {
+        info.write(0, 32);
+    }
+    out->write(reinterpret_cast<const char*>(info.getBytes().data()), static_cast<std::streamsize>(info.getBytes().size()));
+}
+
+} // namespace fsbtool
@@ -0,0 +1,48 @@
+﻿#pragma once
+
+#include "Wav.h"
+
+// Standard C++ headers
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace fsbtool {
+
+// FLAC encoder for integer PCM. Frames are independent, so write() collects a batch of blocks and
+// encodes them on separate threads before appending them in order. Levels 0-8 follow the
+// reference encoder loosely: 0 uses fixed predictors on independent channels, 1-2 add stereo
+// decorrelation, 3 and up add LPC with more orders and finer Rice partitions as the level rises.
+class FlacEncoder {
+public:
+    static constexpr unsigned int kBlockSize = 4096;
+    static constexpr unsigned int kBlocksPerThread = 4;
+
+    ~FlacEncoder() { close(); }
+
+    // Float PCM is not supported. The STREAMINFO sizes are patched on close when out can seek.
+    bool open(std::ostream& out, const WavFormat& format, int level, unsigned int threads);
+    void write(const void* data, unsigned int frames);
+    bool close();
+
+    uint64_t getFrames() const { return totalFrames; }
+
+private:
+    void encodeBatch(size_t blocks);
+    void writeStreamInfo();
+
+    std::ostream* out = nullptr;
+    WavFormat format;
+    int level = 5;
+    unsigned int threads = 1;
+
+    // Interleaved samples waiting for a full batch
+    std::vector<int32_t> pending;
+    uint64_t totalFrames = 0;
+    uint32_t frameNumber = 0;
+    uint32_t minFrameBytes = 0;
+    uint32_t maxFrameBytes = 0;
+    std::streampos streamInfoPos = -1;
+};
+
+} // namespace fsbtool
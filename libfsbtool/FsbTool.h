@@ -0,0 +1,23 @@
+﻿#pragma once
+
+// Public API of libfsbtool. BankReader and SubsoundDecoder read banks, BankBuilder writes them,
+// and the mode functions are what the FSB_Tool command line runs.
+#include "Archive.h"
+#include "BankBuilder.h"
+#include "BankReader.h"
+#include "Common.h"
+#include "Create.h"
+#include "Dataset.h"
+#include "Dump.h"
+#include "Features.h"
+#include "FileCache.h"
+#include "Flac.h"
+#include "Loudness.h"
+#include "MixOutput.h"
+#include "Options.h"
+#include "PcmStream.h"
+#include "Peaks.h"
+#include "Resampler.h"
+#include "Scan.h"
+#include "Server.h"
+#include "Wav.h"
@@ -0,0 +1,123 @@
+﻿#include "Loudness.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <cmath>
+
+namespace fsbtool {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kAbsoluteGate = -70.0;
+constexpr double kRelativeGate = -10.0;
+constexpr int kStepsPerBlock = 4;
+
+double toLoudness(double energy) {
+    return energy > 0.0 ? -0.691 + 10.0 * std::log10(energy) : -HUGE_VAL;
+}
+
+} // namespace
+
+void LoudnessMeter::begin(int channelCount, int sampleRate) {
+    channels = channelCount;
+    rate = sampleRate;
+
+    // The BS.1770 pre-filter and RLB high-pass, designed for this rate rather than taking the
+    // published 48 kHz coefficients
+    double k = std::tan(kPi * 1681.974450955533 / rate);
+    double q = 0.7071752369554196;
+    double vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    shelf = { (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+
+    k = std::tan(kPi * 38.13547087602444 / rate);
+    q = 0.5003270373238773;
+    a0 = 1.0 + k / q + k * k;
+    highPass = { 1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+
+    weights.assign(channels, 1.0);
+    if (channels == 6 || channels == 8) {
+        weights[3] = 0.0;
+        for (int c = 4; c < channels; ++c) {
+            weights[c] = 1.41;
+        }
+    }
+
+    state.assign(static_cast<size_t>(channels) * 4, 0.0);
+    stepFrames = std::max(1, rate / 10);
+    stepFilled = 0;
+    stepEnergy = 0.0;
+    steps.clear();
+    peak = 0.0f;
+}
+
+void LoudnessMeter::add(const float* samples, unsigned int frames) {
+    for (unsigned int f = 0; f < frames; ++f) {
+        const float* frame = samples + static_cast<size_t>(f) * channels;
+        for (int c = 0; c < channels; ++c) {
+            peak = std::max(peak, std::fabs(frame[c]));
+            if (weights[c] == 0.0) {
+                continue;
+            }
+
+            // Transposed direct form II, shelf then high-pass
+            double* z = state.data() + static_cast<size_t>(c) * 4;
+            double x = frame[c];
+            double y = shelf.b0 * x + z[0];
+            z[0] = shelf.b1 * x - shelf.a1 * y + z[1];
+            z[1] = shelf.b2 * x - shelf.a2 * y;
+            x = y;
+            y = highPass.b0 * x + z[2];
+            z[2] = highPass.b1 * x - highPass.a1 * y + z[3];
+            z[3] = highPass.b2 * x - highPass.a2 * y;
+            stepEnergy += weights[c] * y * y;
+        }
+
+        if (++stepFilled == stepFrames) {
+            steps.push_back(stepEnergy);
+            stepEnergy = 0.0;
+            stepFilled = 0;
+        }
+    }
+}
+
+double LoudnessMeter::getIntegrated() const {
+    std::vector<double> blocks;
+    for (size_t s = 0; s + kStepsPerBlock <= steps.size(); ++s) {
+        double energy = 0.0;
+        for (int b = 0; b < kStepsPerBlock; ++b) {
+            energy += steps[s + b];
+        }
+        blocks.push_back(energy / (static_cast<double>(stepFrames) * kStepsPerBlock));
+    }
+    if (blocks.empty()) {
+        double energy = stepEnergy;
+        for (double step : steps) {
+            energy += step;
+        }
+        uint64_t frames = static_cast<uint64_t>(steps.size()) * stepFrames + stepFilled;
+        return frames ? toLoudness(energy / frames) : -HUGE_VAL;
+    }
+
+    auto gatedMean = [&](double threshold) {
+        double sum = 0.0;
+        size_t count = 0;
+        for (double energy : blocks) {
+            if (toLoudness(energy) > threshold) {
+                sum += energy;
+                ++count;
+            }
+        }
+        return count ? sum / count : 0.0;
+    };
+
+    double absolute = gatedMean(kAbsoluteGate);
+    if (absolute <= 0.0) {
+        return -HUGE_VAL;
+    }
+    return toLoudness(gatedMean(toLoudness(absolute) + kRelativeGate));
+}
+
+} // namespace fsbtool
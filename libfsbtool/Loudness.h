@@ -0,0 +1,43 @@
+﻿#pragma once
+
+// Standard C++ headers
+#include <cstdint>
+#include <vector>
+
+namespace fsbtool {
+
+// Integrated loudness after ITU-R BS.1770 / EBU R128, fed with interleaved float PCM as it is
+// decoded. Each channel is K-weighted, blocks of 400 ms overlapping by 75% are gated at -70 LUFS
+// and then 10 LU below the mean of the blocks left. In 5.1 and 7.1 the LFE is left out and the
+// channels after it weighted +1.5 dB. A source shorter than one block is measured whole.
+class LoudnessMeter {
+public:
+    void begin(int channels, int rate);
+    void add(const float* samples, unsigned int frames);
+
+    // LUFS, or -HUGE_VAL when every block was gated out
+    double getIntegrated() const;
+    // Largest sample magnitude seen
+    float getPeak() const { return peak; }
+
+private:
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+    };
+
+    int channels = 0;
+    int rate = 0;
+    Biquad shelf = {};
+    Biquad highPass = {};
+    std::vector<double> weights;
+    // Two biquads of two delayed values per channel
+    std::vector<double> state;
+    unsigned int stepFrames = 0;
+    unsigned int stepFilled = 0;
+    double stepEnergy = 0.0;
+    // Weighted energy of each 100 ms step, four of which make a block
+    std::vector<double> steps;
+    float peak = 0.0f;
+};
+
+} // namespace fsbtool
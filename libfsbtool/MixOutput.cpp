@@ -0,0 +1,101 @@
+﻿#include "MixOutput.h"
+
+// Standard C++ headers
+#include <cstdio>
+
+namespace fsbtool {
+
+namespace {
+
+FMOD_RESULT F_CALL outputGetNumDrivers(FMOD_OUTPUT_STATE*, int* numDrivers) {
+    *numDrivers = 1;
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALL outputGetDriverInfo(FMOD_OUTPUT_STATE*, int, char* name, int nameLength, FMOD_GUID* guid, int* rate, FMOD_SPEAKERMODE* speakerMode, int* channels) {
+    if (name && nameLength > 0) {
+        snprintf(name, nameLength, "fsbtool mix");
+    }
+    if (guid) {
+        *guid = FMOD_GUID();
+    }
+    *rate = 48000;
+    *speakerMode = FMOD_SPEAKERMODE_STEREO;
+    *channels = 2;
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALL outputInit(FMOD_OUTPUT_STATE* state, int, FMOD_INITFLAGS, int* rate, FMOD_SPEAKERMODE* speakerMode, int* channels, FMOD_SOUND_FORMAT* outputFormat, int bufferLength, int*, int*, void* extraDriverData) {
+    if (!extraDriverData) {
+        return FMOD_ERR_INVALID_PARAM;
+    }
+    state->plugindata = extraDriverData;
+    return static_cast<MixOutput*>(extraDriverData)->onInit(rate, speakerMode, channels, outputFormat, bufferLength);
+}
+
+FMOD_RESULT F_CALL outputUpdate(FMOD_OUTPUT_STATE* state) {
+    return static_cast<MixOutput*>(state->plugindata)->onUpdate(state);
+}
+
+FMOD_RESULT F_CALL outputClose(FMOD_OUTPUT_STATE* state) {
+    state->plugindata = nullptr;
+    return FMOD_OK;
+}
+
+} // namespace
+
+FMOD_RESULT MixOutput::init(FMOD::System* system, int maxChannels, FMOD_INITFLAGS flags) {
+    FMOD_OUTPUT_DESCRIPTION description = {};
+    description.apiversion = FMOD_OUTPUT_PLUGIN_VERSION;
+    description.name = "fsbtool mix";
+    description.version = 1;
+    description.method = FMOD_OUTPUT_METHOD_MIX_DIRECT;
+    description.getnumdrivers = outputGetNumDrivers;
+    description.getdriverinfo = outputGetDriverInfo;
+    description.init = outputInit;
+    description.update = outputUpdate;
+    description.close = outputClose;
+
+    unsigned int handle = 0;
+    FMOD_RESULT result = system->registerOutput(&description, &handle);
+    if (result != FMOD_OK) {
+        return result;
+    }
+    result = system->setOutputByPlugin(handle);
+    if (result != FMOD_OK) {
+        return result;
+    }
+    return system->init(maxChannels, flags, this);
+}
+
+FMOD_RESULT MixOutput::onInit(int* rate, FMOD_SPEAKERMODE* speakerMode, int* channels, FMOD_SOUND_FORMAT* outputFormat, int bufferLength) {
+    if (*speakerMode == FMOD_SPEAKERMODE_DEFAULT || *channels <= 0) {
+        *speakerMode = FMOD_SPEAKERMODE_STEREO;
+        *channels = 2;
+    }
+    // 16 bit like the WAV writer, so exports keep their format
+    *outputFormat = FMOD_SOUND_FORMAT_PCM16;
+
+    format.rate = *rate;
+    format.channels = *channels;
+    format.bits = 16;
+    format.isFloat = false;
+
+    blockFrames = bufferLength;
+    block.resize(static_cast<size_t>(blockFrames) * format.frameBytes());
+    return FMOD_OK;
+}
+
+FMOD_RESULT MixOutput::onUpdate(FMOD_OUTPUT_STATE* state) {
+    // One block per System::update, as the non-realtime outputs do
+    FMOD_RESULT result = FMOD_OUTPUT_READFROMMIXER(state, block.data(), blockFrames);
+    if (result != FMOD_OK) {
+        return result;
+    }
+    if (sink) {
+        sink(block.data(), blockFrames);
+    }
+    return FMOD_OK;
+}
+
+} // namespace fsbtool
@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include "Wav.h"
+
+// FMOD headers
+#include "FMOD/fmod.hpp"
+
+// Standard C++ headers
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace fsbtool {
+
+// Receives each block the mixer renders, as interleaved frames in the MixOutput's format
+using MixSink = std::function<void(const void* data, unsigned int frames)>;
+
+// FMOD output plugin that hands mixed blocks to an in-process sink instead of a file. The mixer
+// only runs from System::update, so like WAVWRITER_NRT it renders as fast as the sink takes the
+// blocks, and one System can feed any number of outputs by switching the sink between sounds.
+class MixOutput {
+public:
+    // Registers the plugin on system, selects it and initialises the System
+    FMOD_RESULT init(FMOD::System* system, int maxChannels, FMOD_INITFLAGS flags);
+
+    // Valid once init has succeeded
+    const WavFormat& getFormat() const { return format; }
+    // Blocks mixed while no sink is set are dropped
+    void setSink(MixSink sink) { this->sink = std::move(sink); }
+
+    FMOD_RESULT onInit(int* rate, FMOD_SPEAKERMODE* speakerMode, int* channels, FMOD_SOUND_FORMAT* outputFormat, int bufferLength);
+    FMOD_RESULT onUpdate(FMOD_OUTPUT_STATE* state);
+
+private:
+    WavFormat format;
+    unsigned int blockFrames = 0;
+    std::vector<char> block;
+    MixSink sink;
+};
+
+} // namespace fsbtool
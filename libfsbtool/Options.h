@@ -0,0 +1,86 @@
+﻿#pragma once
+
+// Standard C++ headers
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+enum class DedupMode {
+    Off,
+    Alias,
+    Skip,
+};
+
+// A position in a subsound, given in seconds or in frames
+struct ClipTime {
+    double value = -1.0;
+    bool frames = false;
+
+    bool isSet() const { return value >= 0.0; }
+    unsigned int toFrames(int rate) const { return static_cast<unsigned int>(frames ? value : value * rate + 0.5); }
+};
+
+enum class FeatureKind {
+    Off,
+    Stft,
+    Mel,
+};
+
+// Spectral features written beside each dump: STFT magnitudes, or log mel energies when kind
+// is Mel. window is a power of two.
+struct FeatureSettings {
+    FeatureKind kind = FeatureKind::Off;
+    unsigned int window = 1024;
+    unsigned int hop = 256;
+    unsigned int mels = 64;
+
+    bool isSet() const { return kind != FeatureKind::Off; }
+};
+
+struct ToolOptions {
+    fs::path output;
+    fs::path cacheDirectory;
+    fs::path tracePath;
+    fs::path costReportPath;
+    std::string subsound;
+    ClipTime clipStart;
+    ClipTime clipEnd;
+    ClipTime preview;
+    fs::path previewReelPath;
+    fs::path archivePath;
+    fs::path datasetPath;
+    fs::path trimReportPath;
+    bool progress = true;
+    bool resume = false;
+    bool peaks = false;
+    FeatureSettings features;
+    // Below 0 trims leading and trailing silence quieter than this many dBFS
+    double trimDb = 0.0;
+    // Below 0 normalises every source to this integrated loudness in LUFS before the build
+    double normalizeLufs = 0.0;
+    bool toStdout = false;
+    bool rawPcm = false;
+    // -1 keeps WAV output, 0-8 is the FLAC compression level
+    int flacLevel = -1;
+    bool extract = false;
+    DedupMode dedup = DedupMode::Off;
+    uint64_t maxBankSize = 0;
+    uint64_t fmodPoolSize = 0;
+    unsigned int readBlockSize = 1024 * 1024;
+    // 0 keeps each subsound's own rate and channel count in a dataset
+    unsigned int datasetRate = 0;
+    unsigned int datasetChannels = 0;
+    unsigned int timeout = 0;
+    unsigned int maxEntries = 0;
+    unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+};
+
+} // namespace fsbtool
@@ -0,0 +1,97 @@
+﻿#pragma once
+
+// Standard C++ headers
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace fsbtool {
+
+// Streaming XXH64. Four independent lanes over 32 byte stripes keep it at memory speed,
+// well ahead of the FMOD decode that feeds it.
+class PcmHasher {
+public:
+    void update(const void* data, size_t length) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        totalLength += length;
+
+        if (pendingLength) {
+            size_t take = std::min(length, sizeof(pending) - pendingLength);
+            memcpy(pending + pendingLength, bytes, take);
+            pendingLength += take;
+            bytes += take;
+            length -= take;
+            if (pendingLength < sizeof(pending)) {
+                return;
+            }
+            stripe(pending);
+            pendingLength = 0;
+        }
+
+        for (; length >= sizeof(pending); bytes += sizeof(pending), length -= sizeof(pending)) {
+            stripe(bytes);
+        }
+
+        memcpy(pending, bytes, length);
+        pendingLength = length;
+    }
+
+    uint64_t digest() const {
+        uint64_t hash;
+        if (totalLength >= sizeof(pending)) {
+            hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+            for (uint64_t lane : lanes) {
+                hash = (hash ^ round(0, lane)) * kPrime1 + kPrime4;
+            }
+        }
+        else {
+            hash = kPrime5;
+        }
+        hash += totalLength;
+
+        size_t i = 0;
+        for (; i + 8 <= pendingLength; i += 8) {
+            hash = rotl(hash ^ round(0, read64(pending + i)), 27) * kPrime1 + kPrime4;
+        }
+        if (i + 4 <= pendingLength) {
+            hash = rotl(hash ^ (read32(pending + i) * kPrime1), 23) * kPrime2 + kPrime3;
+            i += 4;
+        }
+        for (; i < pendingLength; ++i) {
+            hash = rotl(hash ^ (pending[i] * kPrime5), 11) * kPrime1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= kPrime2;
+        hash ^= hash >> 29;
+        hash *= kPrime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+private:
+    static constexpr uint64_t kPrime1 = 11400714785074694791ULL;
+    static constexpr uint64_t kPrime2 = 14029467366897019727ULL;
+    static constexpr uint64_t kPrime3 = 1609587929392839161ULL;
+    static constexpr uint64_t kPrime4 = 9650029242287828579ULL;
+    static constexpr uint64_t kPrime5 = 2870177450012600261ULL;
+
+    static uint64_t rotl(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+    static uint64_t round(uint64_t acc, uint64_t input) { return rotl(acc + input * kPrime2, 31) * kPrime1; }
+    static uint64_t read64(const unsigned char* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+    static uint64_t read32(const unsigned char* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+    void stripe(const unsigned char* p) {
+        lanes[0] = round(lanes[0], read64(p));
+        lanes[1] = round(lanes[1], read64(p + 8));
+        lanes[2] = round(lanes[2], read64(p + 16));
+        lanes[3] = round(lanes[3], read64(p + 24));
+    }
+
+    uint64_t lanes[4] = { kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1 };
+    unsigned char pending[32] = {};
+    size_t pendingLength = 0;
+    uint64_t totalLength = 0;
+};
+
+} // namespace fsbtool
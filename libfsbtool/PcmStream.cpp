@@ -0,0 +1,237 @@
+﻿#include "PcmStream.h"
+#include "BankReader.h"
+#include "Common.h"
+#include "Dump.h"
+#include "FileCache.h"
+#include "Wav.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Boost libraries
+#include <boost/nowide/convert.hpp>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace fsbtool {
+
+namespace {
+
+constexpr unsigned int kBlockFrames = 65536;
+constexpr size_t kStdoutBuffer = 4 * 1024 * 1024;
+
+void appendLE(std::string& out, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+// Buffered binary stdout shared by the workers. Once a write fails, usually because the reader
+// closed the pipe, every later write is dropped and the workers stop.
+class StdoutWriter {
+public:
+    StdoutWriter() {
+        // stdout keeps the buffer after the writer is gone, so it lives for the whole process
+        static std::vector<char> buffer(kStdoutBuffer);
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        setvbuf(stdout, buffer.data(), _IOFBF, buffer.size());
+    }
+
+    ~StdoutWriter() { fflush(stdout); }
+
+    bool write(const void* data, size_t size) {
+        std::lock_guard<std::mutex> guard(lock);
+        return writeLocked(data, size);
+    }
+
+    // The frame header and its payload go out together, so frames never interleave mid-payload
+    bool writeFrame(const char type[4], int index, const void* payload, size_t size) {
+        std::string header(type, 4);
+        appendLE(header, static_cast<uint32_t>(index), 4);
+        appendLE(header, static_cast<uint32_t>(size), 4);
+
+        std::lock_guard<std::mutex> guard(lock);
+        return writeLocked(header.data(), header.size()) && writeLocked(payload, size);
+    }
+
+    bool flush() {
+        std::lock_guard<std::mutex> guard(lock);
+        failed = failed || fflush(stdout) != 0;
+        return !failed;
+    }
+
+    bool hasFailed() const { return failed; }
+
+private:
+    bool writeLocked(const void* data, size_t size) {
+        if (!failed && size && fwrite(data, 1, size, stdout) != size) {
+            failed = true;
+        }
+        return !failed;
+    }
+
+    std::mutex lock;
+    std::atomic<bool> failed = false;
+};
+
+// Opens the decoder on [start, end) of the subsound, leaving the frame count in frames
+bool openRange(const BankReader& reader, SubsoundDecoder& decoder, int index, const ClipTime& start, const ClipTime& end, unsigned int& frames) {
+    FMOD_RESULT result = reader.openDecoder(index, decoder);
+    if (result != FMOD_OK) {
+        std::wcerr << L"Failed to open subsound " << index << L": " << FMOD_WErrorString(result) << std::endl;
+        return false;
+    }
+
+    unsigned int startFrame = start.isSet() ? start.toFrames(decoder.getRate()) : 0;
+    unsigned int endFrame = end.isSet() ? std::min(end.toFrames(decoder.getRate()), decoder.getLength()) : decoder.getLength();
+    frames = endFrame > startFrame ? endFrame - startFrame : 0;
+    if (startFrame && decoder.seek(startFrame) != FMOD_OK) {
+        std::wcerr << L"Failed to seek subsound " << index << std::endl;
+        return false;
+    }
+    return true;
+}
+
+WavFormat formatOf(const SubsoundDecoder& decoder) {
+    WavFormat format;
+    format.rate = decoder.getRate();
+    format.channels = decoder.getChannels();
+    format.bits = decoder.getBits();
+    format.isFloat = decoder.getFormat() == FMOD_SOUND_FORMAT_PCMFLOAT;
+    return format;
+}
+
+bool streamSingle(const BankReader& reader, int index, const ClipTime& start, const ClipTime& end, bool raw, StdoutWriter& out) {
+    SubsoundDecoder decoder;
+    unsigned int frames = 0;
+    if (!openRange(reader, decoder, index, start, end, frames)) {
+        return false;
+    }
+
+    WavFormat format = formatOf(decoder);
+    if (!raw) {
+        uint64_t dataBytes = static_cast<uint64_t>(frames) * format.frameBytes();
+        std::ostringstream header;
+        writeWavHeader(header, format, dataBytes < 0xFFFFFFFF ? static_cast<uint32_t>(dataBytes) : 0xFFFFFFFF);
+        std::string bytes = header.str();
+        out.write(bytes.data(), bytes.size());
+    }
+
+    std::vector<char> buffer(static_cast<size_t>(kBlockFrames) * format.frameBytes());
+    unsigned int read = 0;
+    while (frames > 0 && !shouldCancel() && decoder.read(buffer.data(), std::min(kBlockFrames, frames), &read) == FMOD_OK && read) {
+        if (!out.write(buffer.data(), static_cast<size_t>(read) * format.frameBytes())) {
+            break;
+        }
+        frames -= read;
+    }
+    return out.flush() && frames == 0;
+}
+
+bool streamMultiplex(const BankReader& reader, const ClipTime& start, const ClipTime& end, unsigned int jobs, StdoutWriter& out) {
+    std::string magic = "FSBM";
+    appendLE(magic, kMultiplexVersion, 4);
+    out.write(magic.data(), magic.size());
+
+    std::atomic<int> next = 0;
+    std::atomic<int> streamed = 0;
+    int numSubsounds = reader.getNumSubsounds();
+
+    auto work = [&]() {
+        SubsoundDecoder decoder;
+        std::vector<char> buffer;
+
+        for (int i = next++; i < numSubsounds && !shouldCancel() && !out.hasFailed(); i = next++) {
+            unsigned int frames = 0;
+            if (!openRange(reader, decoder, i, start, end, frames)) {
+                continue;
+            }
+
+            WavFormat format = formatOf(decoder);
+            std::string begin;
+            appendLE(begin, format.rate, 4);
+            appendLE(begin, format.channels, 2);
+            appendLE(begin, format.bits, 2);
+            appendLE(begin, format.isFloat ? 1 : 0, 2);
+            appendLE(begin, 0, 2);
+            appendLE(begin, frames, 4);
+            begin += reader.getSubsound(i).name;
+            out.writeFrame("BEGN", i, begin.data(), begin.size());
+
+            buffer.resize(static_cast<size_t>(kBlockFrames) * format.frameBytes());
+            unsigned int read = 0;
+            while (frames > 0 && !shouldCancel() && decoder.read(buffer.data(), std::min(kBlockFrames, frames), &read) == FMOD_OK && read) {
+                if (!out.writeFrame("DATA", i, buffer.data(), static_cast<size_t>(read) * format.frameBytes())) {
+                    break;
+                }
+                frames -= read;
+            }
+
+            out.writeFrame("END ", i, nullptr, 0);
+            ++streamed;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int j = 1; j < std::min<unsigned int>(jobs, numSubsounds); ++j) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    std::wcerr << L"Streamed " << streamed << L" of " << numSubsounds << L" subsounds" << (shouldCancel() ? L" (cancelled)" : L"") << std::endl;
+    return out.flush() && streamed == numSubsounds;
+}
+
+} // namespace
+
+bool streamFSB(const fs::path& filePath, const ToolOptions& options) {
+    initFMOD(options.fmodPoolSize);
+    readAheadFiles.setBlockSize(options.readBlockSize);
+
+    BankReader reader;
+    FMOD_RESULT result = reader.open(filePath);
+    if (result != FMOD_OK) {
+        std::wcerr << L"Failed to open " << filePath.wstring() << L": " << FMOD_WErrorString(result) << std::endl;
+        return false;
+    }
+
+    ClipTime start = options.preview.isSet() ? ClipTime() : options.clipStart;
+    ClipTime end = options.preview.isSet() ? options.preview : options.clipEnd;
+
+    StdoutWriter out;
+    bool streamed = false;
+    if (!options.subsound.empty()) {
+        int index = reader.findSubsound(options.subsound);
+        if (index < 0) {
+            std::wcerr << L"No such subsound: " << boost::nowide::widen(options.subsound) << std::endl;
+            return false;
+        }
+        streamed = streamSingle(reader, index, start, end, options.rawPcm, out);
+    }
+    else {
+        streamed = streamMultiplex(reader, start, end, options.jobs, out);
+    }
+
+    if (out.hasFailed()) {
+        std::wcerr << L"Output closed before the stream finished" << std::endl;
+    }
+    return streamed;
+}
+
+} // namespace fsbtool
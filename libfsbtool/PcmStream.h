@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include "Options.h"
+
+// Standard C++ headers
+#include <cstdint>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+// Multiplex layout, all little endian: "FSBM", uint32 version, then frames of uint32 type,
+// uint32 subsound index and uint32 payload size followed by the payload. Each subsound sends one
+// BEGN (uint32 rate, uint16 channels, uint16 bits, uint16 isFloat, uint16 0, uint32 frames,
+// UTF-8 name), its DATA frames in order, then an empty END. Frames of different subsounds
+// interleave.
+constexpr uint32_t kMultiplexVersion = 1;
+
+// Decodes at the native rate and format straight to stdout, with nothing else written there.
+// With options.subsound a single subsound goes out as a WAV, or bare PCM with options.rawPcm, so
+// an encoder reading the pipe starts on the first block. Otherwise every subsound is decoded on
+// options.jobs workers into the multiplex. Clip and preview options apply to both.
+bool streamFSB(const fs::path& filePath, const ToolOptions& options);
+
+} // namespace fsbtool
@@ -0,0 +1,230 @@
+﻿#include "Peaks.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+// Boost libraries
+#include <boost/filesystem/fstream.hpp>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FSBTOOL_SSE2 1
+#endif
+
+namespace fsbtool {
+
+namespace {
+
+template <typename T>
+void writeValue(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+int16_t toSample(float value) {
+    return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+} // namespace
+
+void reduceFrames(const float* samples, unsigned int frames, int channels, float* minimum, float* maximum, double* sumSquares) {
+    size_t count = static_cast<size_t>(frames) * channels;
+    size_t i = 0;
+
+#ifdef FSBTOOL_SSE2
+    // Step over lcm(4, channels) samples so every vector lane always holds the same channel,
+    // then fold the lanes back into channels at the end
+    int stride = std::lcm(4, channels);
+    int vectors = stride / 4;
+    if (vectors <= 8) {
+        __m128 vmin[8];
+        __m128 vmax[8];
+        __m128 vsquares[8];
+        for (int v = 0; v < vectors; ++v) {
+            vmin[v] = _mm_set1_ps(FLT_MAX);
+            vmax[v] = _mm_set1_ps(-FLT_MAX);
+            vsquares[v] = _mm_setzero_ps();
+        }
+
+        for (; i + stride <= count; i += stride) {
+            for (int v = 0; v < vectors; ++v) {
+                __m128 x = _mm_loadu_ps(samples + i + v * 4);
+                vmin[v] = _mm_min_ps(vmin[v], x);
+                vmax[v] = _mm_max_ps(vmax[v], x);
+                vsquares[v] = _mm_add_ps(vsquares[v], _mm_mul_ps(x, x));
+            }
+        }
+
+        alignas(16) float lanesMin[4];
+        alignas(16) float lanesMax[4];
+        alignas(16) float lanesSquares[4];
+        for (int v = 0; v < vectors; ++v) {
+            _mm_store_ps(lanesMin, vmin[v]);
+            _mm_store_ps(lanesMax, vmax[v]);
+            _mm_store_ps(lanesSquares, vsquares[v]);
+            for (int lane = 0; lane < 4; ++lane) {
+                int c = (v * 4 + lane) % channels;
+                minimum[c] = std::min(minimum[c], lanesMin[lane]);
+                maximum[c] = std::max(maximum[c], lanesMax[lane]);
+                sumSquares[c] += lanesSquares[lane];
+            }
+        }
+    }
+#endif
+
+    // i is a whole number of frames here, so i % channels is the channel
+    for (; i < count; ++i) {
+        int c = static_cast<int>(i % channels);
+        minimum[c] = std::min(minimum[c], samples[i]);
+        maximum[c] = std::max(maximum[c], samples[i]);
+        sumSquares[c] += static_cast<double>(samples[i]) * samples[i];
+    }
+}
+
+bool findSignal(const float* samples, unsigned int frames, int channels, float threshold, unsigned int& first, unsigned int& last) {
+    size_t count = static_cast<size_t>(frames) * channels;
+    size_t head = 0;
+    size_t tail = count;
+    bool found = false;
+
+#ifdef FSBTOOL_SSE2
+    // Compare |x| > threshold four samples at a time, the lane of the first set mask bit gives
+    // the sample, and the sample gives the frame
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 limit = _mm_set1_ps(threshold);
+    for (; head + 4 <= count; head += 4) {
+        int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(samples + head), absMask), limit));
+        if (mask) {
+            head += mask & 1 ? 0 : mask & 2 ? 1 : mask & 4 ? 2 : 3;
+            found = true;
+            break;
+        }
+    }
+#endif
+    for (; !found && head < count; ++head) {
+        if (std::fabs(samples[head]) > threshold) {
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+#ifdef FSBTOOL_SSE2
+    for (; tail >= head + 4; tail -= 4) {
+        int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(samples + tail - 4), absMask), limit));
+        if (mask) {
+            tail -= mask & 8 ? 0 : mask & 4 ? 1 : mask & 2 ? 2 : 3;
+            break;
+        }
+    }
+#endif
+    while (std::fabs(samples[tail - 1]) <= threshold) {
+        --tail;
+    }
+
+    first = static_cast<unsigned int>(head / channels);
+    last = static_cast<unsigned int>((tail - 1) / channels);
+    return true;
+}
+
+void PeakPyramid::begin(int numChannels, int sampleRate) {
+    channels = numChannels;
+    rate = sampleRate;
+    totalFrames = 0;
+    pending.assign(static_cast<size_t>(kBaseFrames) * channels, 0.0f);
+    pendingFrames = 0;
+    buckets.clear();
+}
+
+void PeakPyramid::add(const float* samples, unsigned int frames) {
+    totalFrames += frames;
+
+    while (frames > 0) {
+        // Whole buckets straight from the decode buffer, partial ones through pending
+        if (pendingFrames == 0 && frames >= kBaseFrames) {
+            addBucket(samples, kBaseFrames);
+            samples += static_cast<size_t>(kBaseFrames) * channels;
+            frames -= kBaseFrames;
+            continue;
+        }
+
+        unsigned int take = std::min(frames, kBaseFrames - pendingFrames);
+        std::copy(samples, samples + static_cast<size_t>(take) * channels, pending.begin() + static_cast<size_t>(pendingFrames) * channels);
+        pendingFrames += take;
+        samples += static_cast<size_t>(take) * channels;
+        frames -= take;
+
+        if (pendingFrames == kBaseFrames) {
+            addBucket(pending.data(), kBaseFrames);
+            pendingFrames = 0;
+        }
+    }
+}
+
+void PeakPyramid::finish() {
+    if (pendingFrames) {
+        addBucket(pending.data(), pendingFrames);
+        pendingFrames = 0;
+    }
+}
+
+void PeakPyramid::addBucket(const float* samples, unsigned int frames) {
+    std::vector<float> minimum(channels, FLT_MAX);
+    std::vector<float> maximum(channels, -FLT_MAX);
+    std::vector<double> sumSquares(channels, 0.0);
+    reduceFrames(samples, frames, channels, minimum.data(), maximum.data(), sumSquares.data());
+
+    for (int c = 0; c < channels; ++c) {
+        buckets.push_back({ minimum[c], maximum[c], sumSquares[c], frames });
+    }
+}
+
+bool PeakPyramid::save(const fs::path& path) const {
+    fs::ofstream out(path, std::ios::binary | std::ios::trunc);
+    size_t numBuckets = channels ? buckets.size() / channels : 0;
+
+    uint32_t levels = 1;
+    for (size_t span = kLevelFactor; levels < kMaxLevels && span < numBuckets; span *= kLevelFactor) {
+        ++levels;
+    }
+
+    out.write("FSBP", 4);
+    writeValue(out, uint32_t(1));
+    writeValue(out, static_cast<uint32_t>(rate));
+    writeValue(out, static_cast<uint32_t>(channels));
+    writeValue(out, levels);
+    writeValue(out, totalFrames);
+
+    size_t span = 1;
+    for (uint32_t level = 0; level < levels; ++level, span *= kLevelFactor) {
+        uint32_t levelBuckets = static_cast<uint32_t>((numBuckets + span - 1) / span);
+        writeValue(out, static_cast<uint32_t>(kBaseFrames * span));
+        writeValue(out, levelBuckets);
+
+        for (size_t b = 0; b < levelBuckets; ++b) {
+            for (int c = 0; c < channels; ++c) {
+                Bucket merged = { FLT_MAX, -FLT_MAX, 0.0, 0 };
+                for (size_t s = b * span; s < std::min(numBuckets, (b + 1) * span); ++s) {
+                    const Bucket& bucket = buckets[s * channels + c];
+                    merged.minimum = std::min(merged.minimum, bucket.minimum);
+                    merged.maximum = std::max(merged.maximum, bucket.maximum);
+                    merged.sumSquares += bucket.sumSquares;
+                    merged.frames += bucket.frames;
+                }
+
+                float rms = merged.frames ? static_cast<float>(std::sqrt(merged.sumSquares / merged.frames)) : 0.0f;
+                writeValue(out, toSample(merged.minimum));
+                writeValue(out, toSample(merged.maximum));
+                writeValue(out, static_cast<uint16_t>(toSample(rms)));
+            }
+        }
+    }
+
+    return out.good();
+}
+
+} // namespace fsbtool
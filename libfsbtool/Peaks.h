@@ -0,0 +1,57 @@
+﻿#pragma once
+
+// Standard C++ headers
+#include <cstdint>
+#include <vector>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+// Min, max and sum of squares per channel over interleaved float frames, folded into the
+// running values already in minimum, maximum and sumSquares. SSE2 when available.
+void reduceFrames(const float* samples, unsigned int frames, int channels, float* minimum, float* maximum, double* sumSquares);
+
+// First and last frame holding a sample whose magnitude is above threshold, false when every
+// frame is below it. SSE2 when available.
+bool findSignal(const float* samples, unsigned int frames, int channels, float threshold, unsigned int& first, unsigned int& last);
+
+// Min/max/RMS waveform overview, fed with the PCM as it is decoded. The finest level has one
+// bucket per kBaseFrames frames and each level above merges kLevelFactor buckets of the one
+// below. The sidecar is "FSBP", then version, rate, channels, level count and total frames,
+// then per level its bucket frames and bucket count followed by int16 min, int16 max and
+// uint16 RMS for every channel of every bucket. All values are little-endian.
+class PeakPyramid {
+public:
+    static constexpr unsigned int kBaseFrames = 256;
+    static constexpr unsigned int kLevelFactor = 4;
+    static constexpr unsigned int kMaxLevels = 6;
+
+    void begin(int channels, int rate);
+    void add(const float* samples, unsigned int frames);
+    void finish();
+    bool save(const fs::path& path) const;
+
+private:
+    struct Bucket {
+        float minimum;
+        float maximum;
+        double sumSquares;
+        uint32_t frames;
+    };
+
+    void addBucket(const float* samples, unsigned int frames);
+
+    int channels = 0;
+    int rate = 0;
+    uint64_t totalFrames = 0;
+    std::vector<float> pending;
+    unsigned int pendingFrames = 0;
+    // kBaseFrames buckets, channels entries each
+    std::vector<Bucket> buckets;
+};
+
+} // namespace fsbtool
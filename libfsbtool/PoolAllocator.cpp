@@ -0,0 +1,33 @@
+﻿#include "PoolAllocator.h"
+
+namespace fsbtool {
+
+PoolAllocator fsbankPool(L"FSBank");
+
+void* FB_CALL fsbankAlloc(unsigned int size, unsigned int type, const char*) {
+    return fsbankPool.alloc(size, type);
+}
+
+void* FB_CALL fsbankRealloc(void* ptr, unsigned int size, unsigned int type, const char*) {
+    return fsbankPool.realloc(ptr, size, type);
+}
+
+void FB_CALL fsbankFree(void* ptr, unsigned int, const char*) {
+    fsbankPool.free(ptr);
+}
+
+PoolAllocator fmodPool(L"FMOD");
+
+void* F_CALL fmodAlloc(unsigned int size, FMOD_MEMORY_TYPE type, const char*) {
+    return fmodPool.alloc(size, type);
+}
+
+void* F_CALL fmodRealloc(void* ptr, unsigned int size, FMOD_MEMORY_TYPE type, const char*) {
+    return fmodPool.realloc(ptr, size, type);
+}
+
+void F_CALL fmodFree(void* ptr, FMOD_MEMORY_TYPE, const char*) {
+    fmodPool.free(ptr);
+}
+
+} // namespace fsbtool
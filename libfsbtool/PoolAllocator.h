@@ -0,0 +1,217 @@
+﻿#pragma once
+
+// FMOD headers
+#include "FMOD/fmod.hpp"
+
+// FSBANK headers
+#include "FSBANK/fsbank.h"
+
+// Standard C++ headers
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fsbtool {
+
+// Size-classed arena for the FMOD/FSBank memory callbacks. Each thread is pinned to one of
+// several shards, blocks go back to the shard that carved them, and large blocks use the heap.
+class PoolAllocator {
+public:
+    explicit PoolAllocator(const wchar_t* label) : label(label) {}
+
+    void* alloc(unsigned int size, unsigned int type) {
+        unsigned int sizeClass = classFor(size);
+        char* block;
+
+        if (sizeClass == kLargeBlock) {
+            block = static_cast<char*>(malloc(sizeof(BlockHeader) + size));
+            if (!block) {
+                return nullptr;
+            }
+        }
+        else {
+            block = shards[threadShard()].take(sizeClass);
+        }
+
+        BlockHeader* header = reinterpret_cast<BlockHeader*>(block);
+        header->size = size;
+        header->sizeClass = static_cast<uint16_t>(sizeClass);
+        header->shard = static_cast<uint16_t>(threadShard());
+        header->type = type;
+        track(type, size, 1);
+        return block + sizeof(BlockHeader);
+    }
+
+    void* realloc(void* ptr, unsigned int size, unsigned int type) {
+        if (!ptr) {
+            return alloc(size, type);
+        }
+
+        BlockHeader* header = headerOf(ptr);
+        if (header->sizeClass != kLargeBlock && size <= classSize(header->sizeClass)) {
+            track(header->type, static_cast<int64_t>(size) - header->size, 0);
+            header->size = size;
+            return ptr;
+        }
+
+        void* moved = alloc(size, type);
+        if (moved) {
+            memcpy(moved, ptr, std::min(size, header->size));
+            free(ptr);
+        }
+        return moved;
+    }
+
+    void free(void* ptr) {
+        if (!ptr) {
+            return;
+        }
+
+        BlockHeader* header = headerOf(ptr);
+        track(header->type, -static_cast<int64_t>(header->size), 0);
+
+        if (header->sizeClass == kLargeBlock) {
+            ::free(header);
+        }
+        else {
+            shards[header->shard].give(header->sizeClass, reinterpret_cast<char*>(header));
+        }
+    }
+
+    int64_t currentBytes() const { return current; }
+    int64_t peakBytes() const { return peak; }
+
+    // Restarts peak tracking from the current footprint, for per-item reports.
+    void resetPeak() { peak = current.load(); }
+
+    void report() const {
+        uint64_t reserved = 0;
+        for (const auto& shard : shards) {
+            reserved += shard.reserved;
+        }
+
+        std::wcout << label << L" memory: current " << current / 1024 << L" KB, peak " << peak / 1024
+            << L" KB, arena reserved " << reserved / 1024 << L" KB" << std::endl;
+
+        for (unsigned int t = 0; t < kNumTypes; ++t) {
+            if (types[t].allocs) {
+                std::wcout << L"  type 0x" << std::hex << t << std::dec << L": " << types[t].allocs << L" allocs, current "
+                    << types[t].current / 1024 << L" KB, peak " << types[t].peak / 1024 << L" KB" << std::endl;
+            }
+        }
+    }
+
+private:
+    struct BlockHeader {
+        uint32_t size;
+        uint16_t sizeClass;
+        uint16_t shard;
+        uint32_t type;
+        uint32_t padding;
+    };
+
+    struct TypeCounter {
+        std::atomic<uint64_t> allocs = 0;
+        std::atomic<int64_t> current = 0;
+        std::atomic<int64_t> peak = 0;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::vector<char*> freeLists[12];
+        std::vector<std::unique_ptr<char[]>> chunks;
+        char* cursor = nullptr;
+        char* end = nullptr;
+        uint64_t reserved = 0;
+
+        char* take(unsigned int sizeClass) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto& freeList = freeLists[sizeClass];
+            if (!freeList.empty()) {
+                char* block = freeList.back();
+                freeList.pop_back();
+                return block;
+            }
+
+            size_t blockSize = sizeof(BlockHeader) + classSize(sizeClass);
+            if (static_cast<size_t>(end - cursor) < blockSize) {
+                chunks.emplace_back(new char[kChunkSize]);
+                cursor = chunks.back().get();
+                end = cursor + kChunkSize;
+                reserved += kChunkSize;
+            }
+
+            char* block = cursor;
+            cursor += blockSize;
+            return block;
+        }
+
+        void give(unsigned int sizeClass, char* block) {
+            std::lock_guard<std::mutex> guard(lock);
+            freeLists[sizeClass].push_back(block);
+        }
+    };
+
+    static constexpr unsigned int kNumShards = 16;
+    static constexpr unsigned int kNumTypes = 32;
+    static constexpr unsigned int kLargeBlock = 0xFFFF;
+    static constexpr size_t kChunkSize = 1024 * 1024;
+
+    static unsigned int classSize(unsigned int sizeClass) { return 32u << sizeClass; }
+
+    static unsigned int classFor(unsigned int size) {
+        for (unsigned int sizeClass = 0; sizeClass < 12; ++sizeClass) {
+            if (size <= classSize(sizeClass)) {
+                return sizeClass;
+            }
+        }
+        return kLargeBlock;
+    }
+
+    static BlockHeader* headerOf(void* ptr) {
+        return reinterpret_cast<BlockHeader*>(static_cast<char*>(ptr) - sizeof(BlockHeader));
+    }
+
+    static unsigned int threadShard() {
+        static std::atomic<unsigned int> nextShard = 0;
+        thread_local unsigned int shard = nextShard++ % kNumShards;
+        return shard;
+    }
+
+    static void raise(std::atomic<int64_t>& peakValue, int64_t value) {
+        int64_t seen = peakValue;
+        while (value > seen && !peakValue.compare_exchange_weak(seen, value)) {
+        }
+    }
+
+    void track(unsigned int type, int64_t bytes, uint64_t allocs) {
+        TypeCounter& counter = types[type % kNumTypes];
+        counter.allocs += allocs;
+        raise(counter.peak, counter.current += bytes);
+        raise(peak, current += bytes);
+    }
+
+    const wchar_t* label;
+    Shard shards[kNumShards];
+    TypeCounter types[kNumTypes];
+    std::atomic<int64_t> current = 0;
+    std::atomic<int64_t> peak = 0;
+};
+
+extern PoolAllocator fsbankPool;
+extern PoolAllocator fmodPool;
+
+void* FB_CALL fsbankAlloc(unsigned int size, unsigned int type, const char* sourceStr);
+void* FB_CALL fsbankRealloc(void* ptr, unsigned int size, unsigned int type, const char* sourceStr);
+void FB_CALL fsbankFree(void* ptr, unsigned int type, const char* sourceStr);
+
+void* F_CALL fmodAlloc(unsigned int size, FMOD_MEMORY_TYPE type, const char* sourceStr);
+void* F_CALL fmodRealloc(void* ptr, unsigned int size, FMOD_MEMORY_TYPE type, const char* sourceStr);
+void F_CALL fmodFree(void* ptr, FMOD_MEMORY_TYPE type, const char* sourceStr);
+
+} // namespace fsbtool
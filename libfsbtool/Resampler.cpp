@@ -0,0 +1,95 @@
+﻿#include "Resampler.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <cmath>
+
+namespace fsbtool {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+} // namespace
+
+Resampler::Resampler(int channelCount, int fromRate, int toRate) : channels(channelCount), inputRate(fromRate), outputRate(toRate) {
+    scale = std::min(1.0, static_cast<double>(outputRate) / inputRate);
+    halfWidth = kZeroCrossings / scale;
+
+    table.resize(static_cast<size_t>(std::ceil(halfWidth * kTableResolution)) + 2);
+    for (size_t i = 0; i < table.size(); ++i) {
+        double x = static_cast<double>(i) / kTableResolution;
+        if (x >= halfWidth) {
+            table[i] = 0.0f;
+            continue;
+        }
+        double sinc = x == 0.0 ? 1.0 : std::sin(kPi * scale * x) / (kPi * scale * x);
+        double phase = kPi * x / halfWidth;
+        double window = 0.42 + 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+        table[i] = static_cast<float>(scale * sinc * window);
+    }
+}
+
+uint64_t Resampler::outputFrames(uint64_t frames) const {
+    return (frames * outputRate + inputRate - 1) / inputRate;
+}
+
+float Resampler::kernel(double x) const {
+    double position = std::fabs(x) * kTableResolution;
+    size_t index = static_cast<size_t>(position);
+    if (index + 1 >= table.size()) {
+        return 0.0f;
+    }
+    float frac = static_cast<float>(position - index);
+    return table[index] + (table[index + 1] - table[index]) * frac;
+}
+
+void Resampler::process(const float* input, size_t frames, std::vector<float>& output) {
+    buffer.insert(buffer.end(), input, input + frames * channels);
+    inputFrames += frames;
+    emit(output, UINT64_MAX, false);
+}
+
+void Resampler::flush(std::vector<float>& output) {
+    emit(output, outputFrames(inputFrames), true);
+}
+
+void Resampler::emit(std::vector<float>& output, uint64_t limit, bool final) {
+    int64_t reach = static_cast<int64_t>(std::ceil(halfWidth));
+    std::vector<double> sums(channels);
+
+    for (; nextOutput < limit; ++nextOutput) {
+        // Output frame j sits at input time j * inputRate / outputRate
+        uint64_t scaled = nextOutput * inputRate;
+        int64_t center = static_cast<int64_t>(scaled / outputRate);
+        double time = center + static_cast<double>(scaled % outputRate) / outputRate;
+        int64_t last = center + reach;
+        if (!final && last >= static_cast<int64_t>(inputFrames)) {
+            break;
+        }
+
+        std::fill(sums.begin(), sums.end(), 0.0);
+        int64_t first = std::max<int64_t>(center - reach + 1, bufferStart);
+        last = std::min<int64_t>(last, inputFrames - 1);
+        for (int64_t k = first; k <= last; ++k) {
+            float weight = kernel(k - time);
+            const float* frame = buffer.data() + (k - bufferStart) * channels;
+            for (int c = 0; c < channels; ++c) {
+                sums[c] += weight * frame[c];
+            }
+        }
+        for (int c = 0; c < channels; ++c) {
+            output.push_back(static_cast<float>(sums[c]));
+        }
+    }
+
+    // Input before the next output's window is never read again
+    int64_t keepFrom = static_cast<int64_t>(nextOutput * inputRate / outputRate) - reach + 1;
+    if (keepFrom > static_cast<int64_t>(bufferStart)) {
+        uint64_t drop = std::min<uint64_t>(keepFrom - bufferStart, buffer.size() / channels);
+        buffer.erase(buffer.begin(), buffer.begin() + drop * channels);
+        bufferStart += drop;
+    }
+}
+
+} // namespace fsbtool
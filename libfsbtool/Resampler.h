@@ -0,0 +1,47 @@
+﻿#pragma once
+
+// Standard C++ headers
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fsbtool {
+
+// Windowed-sinc resampler for interleaved float, fed in blocks of any size. The Blackman
+// windowed kernel spans kZeroCrossings on each side and widens by the rate ratio when
+// downsampling, so the cutoff follows the lower of the two Nyquist rates. It is tabulated once
+// per instance and read with linear interpolation.
+class Resampler {
+public:
+    static constexpr int kZeroCrossings = 16;
+    static constexpr int kTableResolution = 512;
+
+    Resampler(int channels, int inputRate, int outputRate);
+
+    // Output frames for inputFrames of input, as process() and flush() together produce them
+    uint64_t outputFrames(uint64_t inputFrames) const;
+
+    // Appends every output frame whose input window has arrived
+    void process(const float* input, size_t frames, std::vector<float>& output);
+    // Appends the remaining output, treating the input past the end as silence
+    void flush(std::vector<float>& output);
+
+private:
+    void emit(std::vector<float>& output, uint64_t limit, bool final);
+    float kernel(double x) const;
+
+    int channels;
+    int inputRate;
+    int outputRate;
+    double scale;
+    double halfWidth;
+    std::vector<float> table;
+
+    // Interleaved input from frame bufferStart on
+    std::vector<float> buffer;
+    uint64_t bufferStart = 0;
+    uint64_t inputFrames = 0;
+    uint64_t nextOutput = 0;
+};
+
+} // namespace fsbtool
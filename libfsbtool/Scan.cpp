@@ -0,0 +1,198 @@
+﻿#include "Scan.h"
+#include "BankReader.h"
+#include "Common.h"
+#include "Dump.h"
+#include "FileCache.h"
+
+// Standard C++ headers
+#include <atomic>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+// Boost libraries
+#include <boost/nowide/convert.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FSBTOOL_SSE2 1
+#endif
+
+namespace fsbtool {
+
+namespace {
+
+// Highest FSB5 codec id FMOD knows, FMOD_SOUND_FORMAT_OPUS
+constexpr unsigned int kMaxFSB5Codec = 17;
+
+// Smallest FSB5 header, so nothing shorter can hold a bank
+constexpr uint64_t kMinFSB5Size = 0x3C;
+
+bool validateBank(const unsigned char* data, size_t size, EmbeddedBank& bank) {
+    if (!parseFSB5Header(data, size, bank.header)) {
+        return false;
+    }
+
+    const BankHeader& header = bank.header;
+    if (header.version > 1 || header.mode > kMaxFSB5Codec || header.subsounds.empty() || header.headerSize + header.dataSize > size) {
+        return false;
+    }
+    for (const auto& subsound : header.subsounds) {
+        if (subsound.dataOffset >= header.dataSize || subsound.channels == 0 || subsound.rate == 0) {
+            return false;
+        }
+    }
+
+    bank.size = header.headerSize + header.dataSize;
+    return true;
+}
+
+} // namespace
+
+std::vector<uint64_t> findFSB5Magic(const unsigned char* data, size_t size) {
+    std::vector<uint64_t> offsets;
+    size_t i = 0;
+
+#ifdef FSBTOOL_SSE2
+    const __m128i first = _mm_set1_epi8('F');
+    const __m128i second = _mm_set1_epi8('S');
+    for (; i + 16 + 3 <= size; i += 16) {
+        __m128i here = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(here, first), _mm_cmpeq_epi8(next, second)));
+        while (mask) {
+            int bit = 0;
+            while (!(mask & (1 << bit))) {
+                ++bit;
+            }
+            mask &= mask - 1;
+            if (data[i + bit + 2] == 'B' && data[i + bit + 3] == '5') {
+                offsets.push_back(i + bit);
+            }
+        }
+    }
+#endif
+
+    for (; i + 4 <= size; ++i) {
+        if (memcmp(data + i, "FSB5", 4) == 0) {
+            offsets.push_back(i);
+        }
+    }
+    return offsets;
+}
+
+std::vector<EmbeddedBank> findEmbeddedBanks(const unsigned char* data, size_t size) {
+    std::vector<EmbeddedBank> banks;
+    uint64_t searchFrom = 0;
+
+    for (uint64_t offset : findFSB5Magic(data, size)) {
+        if (offset < searchFrom) {
+            continue;
+        }
+
+        EmbeddedBank bank;
+        bank.offset = offset;
+        if (validateBank(data + offset, static_cast<size_t>(size - offset), bank)) {
+            searchFrom = offset + bank.size;
+            banks.push_back(std::move(bank));
+        }
+    }
+    return banks;
+}
+
+void scanFile(const fs::path& filePath, const ToolOptions& options) {
+    namespace bi = boost::interprocess;
+
+    // An empty file cannot be mapped, and one shorter than a header holds no bank
+    boost::system::error_code ec;
+    uint64_t fileSize = fs::file_size(filePath, ec);
+    if (ec || fileSize < kMinFSB5Size) {
+        std::wcout << L"Scanned " << filePath.wstring() << L", found 0 banks (" << (ec ? L"cannot read it" : L"too small for an FSB5 header") << L")" << std::endl;
+        return;
+    }
+
+    std::vector<EmbeddedBank> banks;
+    {
+        bi::file_mapping mapping(filePath.c_str(), bi::read_only);
+        bi::mapped_region region(mapping, bi::read_only);
+        auto start = std::chrono::steady_clock::now();
+        banks = findEmbeddedBanks(static_cast<const unsigned char*>(region.get_address()), region.get_size());
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::wcout << L"Scanned " << region.get_size() / (1024 * 1024) << L" MB in " << elapsed << L"s, found " << banks.size() << L" banks" << std::endl;
+    }
+
+    for (const auto& bank : banks) {
+        std::wcout << L"0x" << std::hex << std::setw(10) << std::setfill(L'0') << bank.offset << std::dec << std::setfill(L' ')
+            << L"  " << bank.size / 1024 << L" KB, " << bank.header.subsounds.size() << L" subsounds, codec " << bank.header.mode << std::endl;
+    }
+
+    if (!options.extract || banks.empty()) {
+        return;
+    }
+
+    initFMOD(options.fmodPoolSize);
+    readAheadFiles.setBlockSize(options.readBlockSize);
+
+    // One reader per bank on a shared System; the container is never copied
+    FMOD::System* system = nullptr;
+    FMOD_RESULT result = FMOD::System_Create(&system);
+    ERRCHECK(result);
+    result = readAheadFiles.install(system);
+    ERRCHECK(result);
+    result = system->setOutput(FMOD_OUTPUTTYPE_NOSOUND_NRT);
+    ERRCHECK(result);
+    result = system->init(32, FMOD_INIT_NORMAL, nullptr);
+    ERRCHECK(result);
+
+    size_t exported = 0;
+    for (const auto& bank : banks) {
+        if (shouldCancel()) {
+            break;
+        }
+
+        wchar_t suffix[32];
+        swprintf(suffix, 32, L"_%010llx", static_cast<unsigned long long>(bank.offset));
+        fs::path outputDir = fs::current_path() / (filePath.stem().wstring() + suffix);
+
+        BankReader reader(system);
+        result = reader.open(filePath, bank.offset, bank.size);
+        if (result != FMOD_OK) {
+            std::wcerr << L"Failed to open bank at 0x" << std::hex << bank.offset << std::dec << L": " << FMOD_WErrorString(result) << std::endl;
+            continue;
+        }
+        fs::create_directories(outputDir);
+
+        std::atomic<int> nextSubsound = 0;
+        std::atomic<size_t> bankExported = 0;
+        auto work = [&]() {
+            SubsoundDecoder decoder;
+            for (int i = nextSubsound++; i < reader.getNumSubsounds() && !shouldCancel(); i = nextSubsound++) {
+                std::string name = reader.getSubsound(i).name;
+                fs::path outputPath = outputDir / boost::nowide::widen((name.empty() ? std::to_string(i) : name) + ".wav");
+                if (exportClip(reader, decoder, i, ClipTime(), ClipTime(), outputPath, options.peaks)) {
+                    ++bankExported;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t j = 1; j < std::min<size_t>(options.jobs, reader.getNumSubsounds()); ++j) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        exported += bankExported;
+    }
+
+    readAheadFiles.addUsage(system);
+    system->release();
+    std::wcout << L"Extracted " << exported << L" subsounds" << (shouldCancel() ? L" (cancelled)" : L"") << std::endl;
+    readAheadFiles.report();
+}
+
+} // namespace fsbtool
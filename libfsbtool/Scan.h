@@ -0,0 +1,30 @@
+﻿#pragma once
+
+#include "BankHeader.h"
+#include "Options.h"
+
+// Standard C++ headers
+#include <cstdint>
+#include <vector>
+
+namespace fsbtool {
+
+struct EmbeddedBank {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    BankHeader header;
+};
+
+// Offsets of every "FSB5" in data. SSE2 compares 16 positions at a time against the first two
+// bytes and only the hits are checked in full.
+std::vector<uint64_t> findFSB5Magic(const unsigned char* data, size_t size);
+
+// Candidates whose header parses and whose sample data fits in the file. The search resumes
+// after each accepted bank, so audio inside one is never taken for another header.
+std::vector<EmbeddedBank> findEmbeddedBanks(const unsigned char* data, size_t size);
+
+// Memory-maps any file and lists the FSB5 banks inside it. With --extract, every subsound is
+// decoded straight from the container through FMOD's fileoffset and length into a folder per bank.
+void scanFile(const fs::path& filePath, const ToolOptions& options);
+
+} // namespace fsbtool
@@ -0,0 +1,334 @@
+﻿#include "Server.h"
+#include "BankReader.h"
+#include "Common.h"
+#include "Dump.h"
+
+// Standard C++ headers
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// Boost libraries
+#include <boost/algorithm/string.hpp>
+#include <boost/nowide/convert.hpp>
+#include <boost/asio.hpp>
+
+namespace fsbtool {
+
+namespace {
+
+class ExtractionServer {
+public:
+    ExtractionServer() {
+        FMOD_RESULT result;
+
+        result = FMOD::System_Create(&system);
+        ERRCHECK(result);
+
+        result = system->setOutput(FMOD_OUTPUTTYPE_NOSOUND_NRT);
+        ERRCHECK(result);
+
+        result = system->init(32, FMOD_INIT_NORMAL, nullptr);
+        ERRCHECK(result);
+    }
+
+    ~ExtractionServer() {
+        banks.clear();
+        system->release();
+    }
+
+    void run(const fs::path& socketPath) {
+        boost::system::error_code ec;
+        fs::remove(socketPath, ec);
+
+        boost::asio::io_context io;
+        Local::acceptor acceptor(io, Local::endpoint(boost::nowide::narrow(socketPath.wstring())));
+        boost::asio::steady_timer timer(io);
+
+        std::function<void()> accept = [&]() {
+            acceptor.async_accept([&](const boost::system::error_code& error, Local::socket socket) {
+                if (error) {
+                    return;
+                }
+
+                std::lock_guard<std::mutex> guard(connectionsLock);
+                reapConnections();
+                Connection& connection = connections.emplace_back();
+                connection.socket = std::make_shared<Local::socket>(std::move(socket));
+                connection.thread = std::thread([this, &connection]() {
+                    serveConnection(connection.socket);
+                    connection.finished = true;
+                });
+                accept();
+            });
+        };
+
+        std::function<void()> watchForCancel = [&]() {
+            timer.expires_after(std::chrono::milliseconds(200));
+            timer.async_wait([&](const boost::system::error_code&) {
+                if (shouldCancel()) {
+                    acceptor.close();
+                }
+                else {
+                    std::lock_guard<std::mutex> guard(connectionsLock);
+                    reapConnections();
+                    watchForCancel();
+                }
+            });
+        };
+
+        accept();
+        watchForCancel();
+        std::wcout << L"Serving on " << socketPath.wstring() << std::endl;
+        io.run();
+
+        // Unblock connections waiting on a read, then wait for them to finish
+        std::lock_guard<std::mutex> guard(connectionsLock);
+        for (auto& connection : connections) {
+            connection.socket->shutdown(Local::socket::shutdown_both, ec);
+        }
+        for (auto& connection : connections) {
+            connection.thread.join();
+        }
+        connections.clear();
+        fs::remove(socketPath, ec);
+    }
+
+private:
+    using Local = boost::asio::local::stream_protocol;
+
+    static constexpr uint32_t kMaxRequestSize = 64 * 1024;
+    // Decoders kept open per bank between requests, and frames per block of a PCM reply
+    static constexpr size_t kMaxIdleDecoders = 4;
+    static constexpr unsigned int kReplyBlockFrames = 16384;
+
+    struct Connection {
+        std::shared_ptr<Local::socket> socket;
+        std::thread thread;
+        std::atomic<bool> finished = false;
+    };
+
+    // A bank kept open between requests. Idle decoders keep their stream of it open, so a
+    // request only switches one to its subsound instead of opening the bank again.
+    struct OpenBank {
+        std::unique_ptr<BankReader> reader;
+        std::mutex decodersLock;
+        std::vector<SubsoundDecoder> decoders;
+        // Bits per decoded sample, the same for every subsound of a bank; 0 until a decoder opens
+        std::atomic<int> bits = 0;
+    };
+
+    static std::vector<char> reply(bool ok, const std::string& text) {
+        std::vector<char> message(1, ok ? 0 : 1);
+        message.insert(message.end(), text.begin(), text.end());
+        return message;
+    }
+
+    static bool send(Local::socket& socket, const std::vector<char>& message) {
+        boost::system::error_code ec;
+        uint32_t messageLength = static_cast<uint32_t>(message.size());
+        std::array<boost::asio::const_buffer, 2> frame = { boost::asio::buffer(&messageLength, sizeof(messageLength)), boost::asio::buffer(message) };
+        boost::asio::write(socket, frame, ec);
+        return !ec;
+    }
+
+    OpenBank* openBank(const std::string& path) {
+        std::lock_guard<std::mutex> guard(banksLock);
+        auto existing = banks.find(path);
+        if (existing != banks.end()) {
+            return existing->second.get();
+        }
+
+        auto bank = std::make_unique<OpenBank>();
+        bank->reader = std::make_unique<BankReader>(system);
+        if (bank->reader->open(boost::nowide::widen(path)) != FMOD_OK) {
+            return nullptr;
+        }
+        return (banks[path] = std::move(bank)).get();
+    }
+
+    static SubsoundDecoder takeDecoder(OpenBank& bank) {
+        std::lock_guard<std::mutex> guard(bank.decodersLock);
+        if (bank.decoders.empty()) {
+            return SubsoundDecoder();
+        }
+        SubsoundDecoder decoder = std::move(bank.decoders.back());
+        bank.decoders.pop_back();
+        return decoder;
+    }
+
+    static void returnDecoder(OpenBank& bank, SubsoundDecoder decoder) {
+        if (decoder.isOpen()) {
+            bank.bits = decoder.getBits();
+        }
+        std::lock_guard<std::mutex> guard(bank.decodersLock);
+        if (decoder.isOpen() && bank.decoders.size() < kMaxIdleDecoders) {
+            bank.decoders.push_back(std::move(decoder));
+        }
+    }
+
+    // The frame length goes out first, so the PCM can follow in blocks as it decodes and a long
+    // subsound never sits in memory whole. A stream that ends early is padded with silence to
+    // the promised length; a decode error closes the connection instead of sending short.
+    static bool sendPcm(Local::socket& socket, SubsoundDecoder& decoder) {
+        uint32_t format[3] = { static_cast<uint32_t>(decoder.getRate()), static_cast<uint32_t>(decoder.getChannels()), static_cast<uint32_t>(decoder.getBits()) };
+        size_t frameBytes = static_cast<size_t>(decoder.getChannels()) * decoder.getBits() / 8;
+        uint64_t messageLength = 1 + sizeof(format) + static_cast<uint64_t>(decoder.getLength()) * frameBytes;
+        if (messageLength > UINT32_MAX) {
+            return send(socket, reply(false, "subsound is over 4 GB as PCM, extract it to a path"));
+        }
+
+        boost::system::error_code ec;
+        uint32_t length = static_cast<uint32_t>(messageLength);
+        char status = 0;
+        std::array<boost::asio::const_buffer, 3> header = { boost::asio::buffer(&length, sizeof(length)), boost::asio::buffer(&status, 1), boost::asio::buffer(format, sizeof(format)) };
+        boost::asio::write(socket, header, ec);
+
+        std::vector<char> block(kReplyBlockFrames * frameBytes);
+        unsigned int total = 0;
+        while (!ec && total < decoder.getLength()) {
+            unsigned int frames = std::min(kReplyBlockFrames, decoder.getLength() - total);
+            unsigned int read = 0;
+            FMOD_RESULT result = decoder.read(block.data(), frames, &read);
+            if (result == FMOD_ERR_FILE_EOF || (result == FMOD_OK && read == 0)) {
+                std::fill(block.begin(), block.end(), 0);
+                read = frames;
+            }
+            else if (result != FMOD_OK) {
+                return false;
+            }
+            boost::asio::write(socket, boost::asio::buffer(block.data(), read * frameBytes), ec);
+            total += read;
+        }
+        return !ec;
+    }
+
+    // Joins the threads of clients that have gone and closes their sockets. Caller holds
+    // connectionsLock.
+    void reapConnections() {
+        for (auto connection = connections.begin(); connection != connections.end();) {
+            if (connection->finished) {
+                connection->thread.join();
+                connection = connections.erase(connection);
+            }
+            else {
+                ++connection;
+            }
+        }
+    }
+
+    // Answers one request on socket, false when the connection should close
+    bool handle(Local::socket& socket, const std::string& request) {
+        std::vector<std::string> fields;
+        boost::algorithm::split(fields, request, boost::algorithm::is_any_of("\t"));
+        if (fields.size() < 2) {
+            return send(socket, reply(false, "malformed request"));
+        }
+
+        OpenBank* bank = openBank(fields[1]);
+        if (!bank) {
+            return send(socket, reply(false, "cannot open bank " + fields[1]));
+        }
+        const BankReader& reader = *bank->reader;
+
+        if (fields[0] == "list") {
+            std::ostringstream listing;
+            for (int i = 0; i < reader.getNumSubsounds(); ++i) {
+                const SubsoundHeader& subsound = reader.getSubsound(i);
+                listing << i << "\t" << subsound.name << "\t" << subsound.lengthPCM << "\t" << subsound.channels << "\t" << subsound.rate << "\n";
+            }
+            return send(socket, reply(true, listing.str()));
+        }
+
+        int index = fields.size() >= 3 ? reader.findSubsound(fields[2]) : -1;
+        if (index < 0) {
+            return send(socket, reply(false, "no such subsound"));
+        }
+
+        // Everything but the decoded sample size is in the header; that is learnt once per bank
+        SubsoundDecoder decoder = takeDecoder(*bank);
+        if (fields[0] == "info") {
+            if (!bank->bits && reader.openDecoder(index, decoder) != FMOD_OK) {
+                return send(socket, reply(false, "cannot open subsound"));
+            }
+            returnDecoder(*bank, std::move(decoder));
+
+            const SubsoundHeader& subsound = reader.getSubsound(index);
+            std::ostringstream info;
+            info << index << "\t" << subsound.name << "\t" << subsound.lengthPCM << "\t" << subsound.channels << "\t" << subsound.rate << "\t" << bank->bits;
+            return send(socket, reply(true, info.str()));
+        }
+
+        // Written in the subsound's own format, the same as the PCM reply
+        if (fields[0] == "extract" && fields.size() >= 4) {
+            fs::path outputPath = fs::absolute(boost::nowide::widen(fields[3]));
+            bool extracted = exportClip(reader, decoder, index, ClipTime(), ClipTime(), outputPath);
+            returnDecoder(*bank, std::move(decoder));
+            if (!extracted) {
+                return send(socket, reply(false, "cannot extract to " + fields[3]));
+            }
+            return send(socket, reply(true, boost::nowide::narrow(outputPath.wstring())));
+        }
+
+        if (fields[0] == "extract") {
+            if (reader.openDecoder(index, decoder) != FMOD_OK) {
+                return send(socket, reply(false, "cannot open subsound"));
+            }
+            bool sent = sendPcm(socket, decoder);
+            returnDecoder(*bank, std::move(decoder));
+            return sent;
+        }
+
+        returnDecoder(*bank, std::move(decoder));
+        return send(socket, reply(false, "unknown command " + fields[0]));
+    }
+
+    void serveConnection(std::shared_ptr<Local::socket> socket) {
+        boost::system::error_code ec;
+
+        while (true) {
+            uint32_t length = 0;
+            if (boost::asio::read(*socket, boost::asio::buffer(&length, sizeof(length)), ec) != sizeof(length) || length > kMaxRequestSize) {
+                break;
+            }
+
+            std::string request(length, '\0');
+            if (boost::asio::read(*socket, boost::asio::buffer(request), ec) != length) {
+                break;
+            }
+
+            if (!handle(*socket, request)) {
+                break;
+            }
+        }
+    }
+
+    FMOD::System* system = nullptr;
+
+    std::mutex banksLock;
+    std::map<std::string, std::unique_ptr<OpenBank>> banks;
+
+    std::mutex connectionsLock;
+    // A list, so running threads keep their entry while others are erased
+    std::list<Connection> connections;
+};
+
+} // namespace
+
+void serve(const fs::path& socketPath, const ToolOptions& options) {
+    initFMOD(options.fmodPoolSize);
+
+    ExtractionServer server;
+    server.run(socketPath);
+}
+
+
+} // namespace fsbtool
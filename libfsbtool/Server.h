@@ -0,0 +1,19 @@
+﻿#pragma once
+
+#include "Options.h"
+
+namespace fsbtool {
+
+// Long running mode that keeps FMOD, opened banks, their name indexes and a few open decoder
+// streams per bank warm between requests. info comes from the header, opening a decoder only
+// the first time a bank is asked, to learn its decoded sample size.
+// Every frame on the socket is a little-endian uint32 length followed by that many bytes.
+// Requests are tab separated UTF-8: "list\t<bank>", "info\t<bank>\t<subsound>" and
+// "extract\t<bank>\t<subsound>[\t<wav path>]", where <subsound> is a name or an index.
+// extract with a path writes the WAV in the subsound's own format and answers with its path.
+// Replies start with a status byte (0 ok, 1 error) followed by text, except extract without a
+// path, which returns uint32 rate, channels and bits followed by the raw PCM, streamed as it
+// decodes. A subsound whose PCM reply would pass 4 GB is refused; extract it to a path instead.
+void serve(const fs::path& socketPath, const ToolOptions& options);
+
+} // namespace fsbtool
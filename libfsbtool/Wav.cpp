@@ -0,0 +1,135 @@
+﻿#include "Wav.h"
+
+// Standard C++ headers
+#include <algorithm>
+
+namespace fsbtool {
+
+namespace {
+
+void writeLE(std::ostream& out, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+} // namespace
+
+void writeWavHeader(std::ostream& out, const WavFormat& format, uint32_t dataBytes) {
+    // Float data needs the 18 byte fmt chunk with an empty extension
+    uint32_t fmtSize = format.isFloat ? 18 : 16;
+    uint32_t riffSize = dataBytes == 0xFFFFFFFF ? dataBytes : 4 + 8 + fmtSize + 8 + dataBytes;
+
+    out.write("RIFF", 4);
+    writeLE(out, riffSize, 4);
+    out.write("WAVE", 4);
+
+    out.write("fmt ", 4);
+    writeLE(out, fmtSize, 4);
+    writeLE(out, format.isFloat ? 3 : 1, 2);
+    writeLE(out, format.channels, 2);
+    writeLE(out, format.rate, 4);
+    writeLE(out, format.rate * format.frameBytes(), 4);
+    writeLE(out, format.frameBytes(), 2);
+    writeLE(out, format.bits, 2);
+    if (format.isFloat) {
+        writeLE(out, 0, 2);
+    }
+
+    out.write("data", 4);
+    writeLE(out, dataBytes, 4);
+}
+
+bool WavFile::open(const fs::path& wavPath, const WavFormat& wavFormat) {
+    close();
+    path = wavPath;
+    format = wavFormat;
+    dataBytes = 0;
+    truncated = false;
+    cues.clear();
+
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    writeWavHeader(out, format, 0);
+    return true;
+}
+
+void WavFile::write(const void* data, unsigned int frames) {
+    out.write(static_cast<const char*>(data), static_cast<std::streamsize>(frames) * format.frameBytes());
+    dataBytes += static_cast<uint64_t>(frames) * format.frameBytes();
+}
+
+void WavFile::truncate(uint64_t frames) {
+    uint64_t bytes = frames * format.frameBytes();
+    if (bytes < dataBytes) {
+        out.seekp(-static_cast<std::streamoff>(dataBytes - bytes), std::ios::cur);
+        dataBytes = bytes;
+        truncated = true;
+    }
+}
+
+void WavFile::addCue(uint64_t frame, const std::string& label) {
+    cues.emplace_back(static_cast<uint32_t>(frame), label);
+}
+
+bool WavFile::close() {
+    if (!out.is_open()) {
+        return false;
+    }
+
+    if (!cues.empty()) {
+        if (dataBytes & 1) {
+            out.put(0);
+        }
+
+        out.write("cue ", 4);
+        writeLE(out, static_cast<uint32_t>(4 + cues.size() * 24), 4);
+        writeLE(out, static_cast<uint32_t>(cues.size()), 4);
+        for (size_t i = 0; i < cues.size(); ++i) {
+            writeLE(out, static_cast<uint32_t>(i + 1), 4);
+            writeLE(out, cues[i].first, 4);
+            out.write("data", 4);
+            writeLE(out, 0, 4);
+            writeLE(out, 0, 4);
+            writeLE(out, cues[i].first, 4);
+        }
+
+        uint32_t listSize = 4;
+        for (const auto& cue : cues) {
+            uint32_t lablSize = static_cast<uint32_t>(4 + cue.second.size() + 1);
+            listSize += 8 + lablSize + (lablSize & 1);
+        }
+        out.write("LIST", 4);
+        writeLE(out, listSize, 4);
+        out.write("adtl", 4);
+        for (size_t i = 0; i < cues.size(); ++i) {
+            uint32_t lablSize = static_cast<uint32_t>(4 + cues[i].second.size() + 1);
+            out.write("labl", 4);
+            writeLE(out, lablSize, 4);
+            writeLE(out, static_cast<uint32_t>(i + 1), 4);
+            out.write(cues[i].second.c_str(), cues[i].second.size() + 1);
+            if (lablSize & 1) {
+                out.put(0);
+            }
+        }
+    }
+
+    // RIFF sizes are 32 bit, anything past 4 GB is still readable as "until end of file"
+    uint64_t fileSize = static_cast<uint64_t>(out.tellp());
+    out.seekp(0);
+    writeWavHeader(out, format, static_cast<uint32_t>(std::min<uint64_t>(dataBytes, 0xFFFFFFFF)));
+    if (!cues.empty()) {
+        out.seekp(4);
+        writeLE(out, static_cast<uint32_t>(std::min<uint64_t>(fileSize - 8, 0xFFFFFFFF)), 4);
+    }
+    bool ok = out.good();
+    out.close();
+    if (ok && truncated) {
+        fs::resize_file(path, fileSize);
+    }
+    return ok;
+}
+
+} // namespace fsbtool
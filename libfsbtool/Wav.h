@@ -0,0 +1,56 @@
+﻿#pragma once
+
+// Standard C++ headers
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+namespace fsbtool {
+
+namespace fs = boost::filesystem;
+
+struct WavFormat {
+    int rate = 0;
+    int channels = 0;
+    int bits = 16;
+    bool isFloat = false;
+
+    unsigned int frameBytes() const { return channels * bits / 8; }
+};
+
+// Writes a RIFF/WAVE header for dataBytes of interleaved PCM. Streams that cannot seek back
+// pass 0xFFFFFFFF, which most readers treat as "until end of file".
+void writeWavHeader(std::ostream& out, const WavFormat& format, uint32_t dataBytes);
+
+// WAV file whose sizes are patched on close, so the length need not be known up front. Cues
+// are written on close as a cue chunk with a labl per cue.
+class WavFile {
+public:
+    ~WavFile() { close(); }
+
+    bool open(const fs::path& path, const WavFormat& format);
+    void write(const void* data, unsigned int frames);
+    // Drops the frames from frames on, later writes carry on from there
+    void truncate(uint64_t frames);
+    void addCue(uint64_t frame, const std::string& label);
+    bool close();
+
+    uint64_t getFrames() const { return dataBytes / format.frameBytes(); }
+
+private:
+    fs::ofstream out;
+    fs::path path;
+    WavFormat format;
+    uint64_t dataBytes = 0;
+    // Set once truncate has left bytes past the end to cut off on close
+    bool truncated = false;
+    std::vector<std::pair<uint32_t, std::string>> cues;
+};
+
+} // namespace fsbtool
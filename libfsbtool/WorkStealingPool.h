@@ -0,0 +1,103 @@
+﻿#pragma once
+
+// Standard C++ headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fsbtool {
+
+// Fixed set of workers, each owning a deque. Owners push and pop at the back and idle workers
+// steal from the back of the others too, so tasks queued by one large bank spread across the
+// pool and, queued in ascending cost, every worker takes the largest task left.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned int numWorkers) : queues(std::max(1u, numWorkers)) {}
+
+    // Tasks submitted from a worker land on that worker's own deque
+    void submit(Task task) {
+        size_t queue = currentPool == this ? currentWorker : nextQueue++ % queues.size();
+        ++pending;
+        std::lock_guard<std::mutex> guard(queues[queue].lock);
+        queues[queue].tasks.push_back(std::move(task));
+    }
+
+    size_t size() const { return queues.size(); }
+
+    // Index of the worker running the caller, for per-worker state; 0 outside a pool
+    static size_t workerIndex() { return currentWorker; }
+
+    // Returns once every task, including those submitted by other tasks, has run
+    void run() {
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < queues.size(); ++i) {
+            workers.emplace_back([this, i]() { work(i); });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    bool pop(size_t worker, Task& task) {
+        std::lock_guard<std::mutex> guard(queues[worker].lock);
+        if (queues[worker].tasks.empty()) {
+            return false;
+        }
+        task = std::move(queues[worker].tasks.back());
+        queues[worker].tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t worker, Task& task) {
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            Queue& victim = queues[(worker + offset) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(size_t worker) {
+        currentPool = this;
+        currentWorker = worker;
+
+        while (pending > 0) {
+            Task task;
+            if (pop(worker, task) || steal(worker, task)) {
+                task();
+                --pending;
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        currentPool = nullptr;
+    }
+
+    static inline thread_local WorkStealingPool* currentPool = nullptr;
+    static inline thread_local size_t currentWorker = 0;
+
+    std::vector<Queue> queues;
+    std::atomic<size_t> pending = 0;
+    std::atomic<size_t> nextQueue = 0;
+};
+
+} // namespace fsbtool